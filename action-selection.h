@@ -0,0 +1,68 @@
+#ifndef ACTION_SELECTION_H
+#define ACTION_SELECTION_H
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+enum ActionSelectionMethod
+{
+    SOFTMAX,
+    PROBABILITY_MATCHING,
+    EPS_GREEDY
+};
+
+// action selection policies -- the learners are templated on these, so picking
+// the weight of a choice costs neither a switch nor a virtual call
+//
+// Weight() gets everything a method could look at:
+//   preference -- the learned preference of the choice (H for the actor-critic, Q for SARSA)
+//   value      -- the value of taking the choice (V of the next state, or Q)
+//   is_optimal -- whether the choice is the current greedy one
+//   num_choices -- how many choices the state has
+// the weights of a state are normalised afterwards
+// uses_preference and uses_value say which of the first two (or is_optimal, which ranks by the
+// value) a method looks at, so a learner can skip invalidating policies a change cannot move
+
+struct Softmax
+{
+    static const ActionSelectionMethod method = SOFTMAX;
+    static const bool uses_preference = true;
+    static const bool uses_value = false;
+
+    static double Weight(double preference, double /*value*/, bool /*is_optimal*/, int /*num_choices*/, double beta, double /*min_R*/, double /*eps*/)
+    {
+        return exp(beta * preference);
+    }
+};
+
+struct ProbabilityMatching
+{
+    static const ActionSelectionMethod method = PROBABILITY_MATCHING;
+    static const bool uses_preference = false;
+    static const bool uses_value = true;
+
+    static double Weight(double /*preference*/, double value, bool /*is_optimal*/, int /*num_choices*/, double /*beta*/, double min_R, double /*eps*/)
+    {
+        return max(value, min_R);
+    }
+};
+
+struct EpsGreedy
+{
+    static const ActionSelectionMethod method = EPS_GREEDY;
+    static const bool uses_preference = false;
+    static const bool uses_value = true;
+
+    static double Weight(double /*preference*/, double /*value*/, bool is_optimal, int num_choices, double /*beta*/, double /*min_R*/, double eps)
+    {
+        if (is_optimal)
+        {
+            return 1 - eps;
+        }
+        return eps / num_choices;
+    }
+};
+
+#endif
@@ -1,62 +1,91 @@
 #ifndef ACTOR_CRITIC_H
 #define ACTOR_CRITIC_H
 
-#define DA_STANDARD
-
 #include "rl-method.h"
+#include "da-interpretation.h"
 
-class ActorCritic : public RLMethod
+// tables, policy inputs and printing -- everything that does not depend on
+// the action selection method or the DA interpretation
+class ActorCriticBase : public RLMethod
 {
-private:
-    map<State*, double> V;
+protected:
+    friend class RLMethod;
+
+    vector<double> V; // by state id
+    vector<double> V_delta; // by state id; mean-field scratch
 
-    Choice* GetOptimalChoice(State *state)
+    int GetOptimalChoice(int state)
     {
-        if (state->type == PROBABILISTIC)
+        if (graph->type[state] == PROBABILISTIC)
         {
-            return NULL;
+            return -1;
         }
-        Transition* result = NULL;
+        int result = -1;
         double V_max = -1e100;
-        for (int i = 0; i < state->out.size(); i++)
+        for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
         {
-            Transition *trans = state->out[i];
-            if (V[trans->to] > V_max)
+            int to = graph->edges[e].to;
+            if (V[to] > V_max)
             {
-                result = trans;
-                V_max = V[trans->to];
+                result = e;
+                V_max = V[to];
             }
         }
-        return dynamic_cast<Choice*>(result);
+        return result;
     }
 
 
-    double GetChoiceWeight(Choice *choice)
+    double ChoicePreference(int choice)
     {
-        switch(method)
+        return H[choice];
+    }
+
+    double ChoiceValue(int choice)
+    {
+        return V[graph->edges[choice].to];
+    }
+
+    // one mean-field trial: every state moves by its expected TD update, every choice by its
+    // expected actor update, all computed from the tables as they were when the trial began
+    template <class Learner>
+    void ExpectedTrial()
+    {
+        ExpectedVisits<Learner>();
+        V_delta.assign(graph->num_states, 0);
+        for (int S = 0; S < graph->num_states; S++)
         {
-            case SOFTMAX:
-            {
-                return exp(beta * H[choice]);
-            }
-            case PROBABILITY_MATCHING:
+            if (graph->terminal[S] || occupancy[S] == 0)
             {
-                State *S_new = choice->to;
-                return max(V[S_new], min_R);
+                continue;
             }
-            case EPS_GREEDY:
+            for (int a = graph->OutBegin(S); a < graph->OutEnd(S); a++)
             {
-                if (choice == optimal[choice->from])
+                const Edge &edge = graph->edges[a];
+                double PE = edge.reward + discount[a] * V[edge.to] - V[S];
+                double weight = occupancy[S] * take_probability[a];
+                V_delta[S] += eta * weight * PE;
+                if (graph->type[S] == DETERMINISTIC)
                 {
-                    return 1 - eps;
+                    H[a] += alpha * weight * PE;
                 }
-                return eps / choice->from->out.size();
-            }
-            default:
-            {
-                return -1e100;
             }
         }
+        for (int S = 0; S < graph->num_states; S++)
+        {
+            V[S] += V_delta[S];
+        }
+        MarkPoliciesStale();
+    }
+
+    void ExpandValues(const CompiledModel *compressed)
+    {
+        vector<double> full_V(graph->num_states, 0);
+        for (int state = 0; state < compressed->num_states; state++)
+        {
+            full_V[compressed->state_origin[state]] = V[state];
+        }
+        FillChainValues(full_V);
+        V.swap(full_V);
     }
 
 public:
@@ -64,15 +93,10 @@ public:
     void Reset()
     {
         RLMethod::Reset();
-        V.clear();
-        for (int i = 0; i < model->states.size(); i++)
-        {
-            State *state = model->states[i];
-            V[state] = 0;
-        }
+        V.assign(graph->num_states, 0);
     }
 
-    ActorCritic(ExperimentalModel *experiment_model,
+    ActorCriticBase(ExperimentalModel *experiment_model,
         double critic_learning_rate,
         double actor_learning_rate,
         double discount_factor,
@@ -98,116 +122,208 @@ public:
         Reset();
     }
 
-    void Trial(bool do_print)
+    const vector<double>& Values()
+    {
+        return V;
+    }
+
+    void Print(ostream &out = cout)
+    {
+        RefreshPolicies();
+        out<<"\n  States:\n";
+        for (int i = 0; i < graph->num_states; i++)
+        {
+            int state = graph->state_order[i];
+            out<<"    V["<<graph->state_name[state]<<"] = "<<V[state]<<", times = "<<state_extras[state].times<<", reward_avg = "<<state_extras[state].reward_avg<<", reward times = "<<state_extras[state].reward_times<<"\n";
+        }
+        out<<"\n  Transitions:\n";
+        for (int i = 0; i < graph->num_transitions; i++)
+        {
+            int trans = graph->transition_order[i];
+            int from = graph->edge_from[trans];
+            out<<"     "<<graph->state_name[from]<<" -> "<<graph->state_name[graph->edges[trans].to]<<": ";
+            if (graph->type[from] == DETERMINISTIC)
+            {
+                out<<"         ("<<graph->action_name[graph->edges[trans].Action()]<<")               policy = "<<policy[trans]<<", H = "<<H[trans];
+            }
+            double prob = (double)transition_extras[trans].times / state_extras[from].times;
+            out<<", PE_avg = "<<transition_extras[trans].PE_avg<<", times = "<<transition_extras[trans].times<<", measured prob = "<<prob<<" ("<<state_extras[from].times<<")";
+            out<<"\n";
+        }
+        out<<"\n  Cue\n";
+        for (int cue = 0; cue < graph->num_cues; cue++)
+        {
+            out<<"    "<<graph->cue_name[cue]<<": reward_avg = "<<cue_extras[cue].reward_avg<<", times = "<<cue_extras[cue].times<<"\n";
+        }
+        out<<"\n";
+    }
+
+};
+
+
+// the learner proper, specialised at compile time on
+//   Selection      -- Softmax, ProbabilityMatching or EpsGreedy (action-selection.h)
+//   Interpretation -- StandardDA or ExtendedDA (da-interpretation.h)
+template <class SelectionPolicy, class InterpretationPolicy>
+class ActorCritic : public ActorCriticBase
+{
+public:
+    typedef SelectionPolicy Selection;
+    typedef InterpretationPolicy Interpretation;
+
+    ActorCritic(ExperimentalModel *experiment_model,
+        double critic_learning_rate,
+        double actor_learning_rate,
+        double discount_factor,
+        double softmax_temperature,
+        double minimum_action_reward,
+        double fraction_wrong_button,
+        double epsilon_greedy_constant) :
+        ActorCriticBase(experiment_model,
+        critic_learning_rate,
+        actor_learning_rate,
+        discount_factor,
+        Selection::method,
+        softmax_temperature,
+        minimum_action_reward,
+        fraction_wrong_button,
+        epsilon_greedy_constant)
+    { }
+
+    // one trial; the trace is compiled out unless traced
+    template <bool traced>
+    void RunTrial(ostream &out)
     {
-        if (do_print) cout<<"\n  ---------------------- TRIAL --------------\n\n";
-        State* S = model->start;
+        if (traced) out<<"\n  ---------------------- TRIAL --------------\n\n";
+        int S = StartState();
         double PE_prev = 0;
-        map<Cue*, double> seen_cues;
-        map<State*, double> seen_cue_states;
-        while (S != model->end)
+        BeginTrial();
+        while (!graph->terminal[S])
         {
             // pick choice or chance and get new state
-            Transition* a = PickTransition(S);
+            int a = PickTransition<ActorCritic>(S);
 
             // calculate prediciton error
-            State *S_new = a->to;
-            double R_new = S_new->reward;
-            double PE = R_new + gamma * V[S_new] - V[S];
+            const Edge &edge = graph->edges[a];
+            int S_new = edge.to;
+            double R_new = edge.reward;
+            double PE = R_new + discount[a] * V[S_new] - V[S];
 
             // update state value
+            // (the choices leading here rank -- and for probability matching, weigh -- by it;
+            // softmax only looks at H, so its policies never move with V)
+            if (Selection::uses_value)
+            {
+                for (int i = graph->in_begin[S]; i < graph->in_begin[S + 1]; i++)
+                {
+                    int from = graph->edge_from[graph->in_edges[i]];
+                    if (graph->type[from] == DETERMINISTIC)
+                    {
+                        InvalidatePolicy<ActorCritic>(from);
+                    }
+                }
+            }
             V[S] += eta * PE;
 
             // update policy
-            if (S->type == DETERMINISTIC)
+            if (graph->type[S] == DETERMINISTIC)
             {
-                H[dynamic_cast<Choice*>(a)] += alpha * PE;
+                if (Selection::uses_preference)
+                {
+                    InvalidatePolicy<ActorCritic>(S);
+                }
+                H[a] += alpha * PE;
             }
             UpdatePolicy(S);
-            if (do_print) cout<<" from "<<S->name<<" (V="<<V[S]<<") to "<<S_new->name<<" (V="<<V[S_new]<<"), PE = "<<PE<<"\n";
+            if (traced) out<<" from "<<graph->state_name[S]<<" (V="<<V[S]<<") to "<<graph->state_name[S_new]<<" (V="<<V[S_new]<<"), PE = "<<PE<<"\n";
 
             // bookkeeping -- average PE per action & prob of chosing this action
-            /* standard interpretation */
-            // this is a hack to make the plotting form the extended DA version work with the standard one
-#ifdef DA_STANDARD
-            if (S->cue == NULL) // go state
-            {
-                UpdateAveragePE(a, PE);
-            }
-            else // cue state
-            {
-                UpdateAveragePE(a, PE_prev);
-            }
-#else
-            /* extended interpretation */
-            UpdateAveragePE(a, PE + PE_prev);
-#endif
+            UpdateAveragePE(a, Interpretation::TransitionPE(graph->cue[S] != -1, PE, PE_prev));
 
-            // bookkeeping -- average reward received per seen cue
-            if (S->cue != NULL && seen_cues.find(S->cue) == seen_cues.end())
-            {
-                seen_cues[S->cue] = 0;
-            }
-            for (map<Cue*, double>::iterator it = seen_cues.begin(); it != seen_cues.end(); it++)
-            {
-                it->second += S->reward;
-            }
-
-            // bookkeeping -- average reward received per seen cue state (similar to above)
-            if (S->cue != NULL && seen_cue_states.find(S) == seen_cue_states.end())
-            {
-                seen_cue_states[S] = 0;
-            }
-            for (map<State*, double>::iterator it = seen_cue_states.begin(); it != seen_cue_states.end(); it++)
-            {
-                it->second += S->reward;
-            }
+            // bookkeeping -- average reward received per seen cue (and cue state)
+            SeeState(S, a);
           
             // move to new state
             PE_prev = PE;
             S = S_new;
         }
-        // bookkeeping -- update the average reward for all cues passed on this trial
-        for (map<Cue*, double>::iterator it = seen_cues.begin(); it != seen_cues.end(); it++)
+        EndTrial();
+    }
+
+    void Trial(bool do_print)
+    {
+        if (do_print)
+        {
+            RunTrial<true>(cout);
+        }
+        else
         {
-            UpdateAverageReward(it->first, it->second);
+            RunTrial<false>(cout);
+        }
+    }
+
+    // the PE of every step out of a state is R + gamma V(next) - V(state), and the one before
+    // it is, on average, that of the steps into the state (none out of a start)
+    void ExpectStatistics(int trials)
+    {
+        ExpectedVisits<ActorCritic>();
+        int T = graph->num_transitions;
+        vector<double> PE(T, 0), PE_prev, credit(T, 0), credited_PE(T, 0);
+        for (int S = 0; S < graph->num_states; S++)
+        {
+            for (int a = graph->OutBegin(S); a < graph->OutEnd(S); a++)
+            {
+                const Edge &edge = graph->edges[a];
+                PE[a] = edge.reward + discount[a] * V[edge.to] - V[S];
+            }
         }
-        // bookkeeping -- same for cue states
-        for (map<State*, double>::iterator it = seen_cue_states.begin(); it != seen_cue_states.end(); it++)
+        Inflow(PE, PE_prev);
+        for (int S = 0; S < graph->num_states; S++)
         {
-            UpdateAverageReward(it->first, it->second);
+            if (graph->terminal[S] || occupancy[S] == 0)
+            {
+                continue;
+            }
+            double PE_prev_avg = PE_prev[S] / occupancy[S];
+            for (int a = graph->OutBegin(S); a < graph->OutEnd(S); a++)
+            {
+                credit[a] = occupancy[S] * take_probability[a];
+                credited_PE[a] = Interpretation::TransitionPE(graph->cue[S] != -1, PE[a], PE_prev_avg);
+            }
         }
+        FillExpectedStatistics(trials, credit, credited_PE);
+        MarkPoliciesStale();
     }
 
-    void Print()
+    void RunExpectedBatch(int count)
     {
-        cout<<"\n  States:\n";
-        for (int i = 0; i < model->states.size(); i++)
+        for (int i = 0; i < count; i++)
         {
-            State *state = model->states[i];
-            cout<<"    V["<<state->name<<"] = "<<V[state]<<", times = "<<state_extras[state].times<<", reward_avg = "<<state_extras[state].reward_avg<<", reward times = "<<state_extras[state].reward_times<<"\n";
+            ExpectedTrial<ActorCritic>();
         }
-        cout<<"\n  Transitions:\n";
-        for (int i = 0; i < model->transitions.size(); i++)
+    }
+
+    void RunBatch(int count, ostream *trace)
+    {
+        if (trace == NULL)
         {
-            Transition *trans = model->transitions[i];
-            cout<<"     "<<trans->from->name<<" -> "<<trans->to->name<<": ";
-            if (trans->from->type == DETERMINISTIC)
+            for (int i = 0; i < count; i++)
             {
-                Choice *choice = dynamic_cast<Choice*>(trans);
-                cout<<"         ("<<choice->name<<")               policy = "<<policy[choice]<<", H = "<<H[choice];
+                RunTrial<false>(cout);
             }
-            double prob = (double)transition_extras[trans].times / state_extras[trans->from].times;
-            cout<<", PE_avg = "<<transition_extras[trans].PE_avg<<", times = "<<transition_extras[trans].times<<", measured prob = "<<prob<<" ("<<state_extras[trans->from].times<<")";
-            cout<<"\n";
         }
-        cout<<"\n  Cue\n";
-        for (int i = 0; i < model->cues.size(); i++)
+        else
         {
-            Cue* cue = model->cues[i];
-            cout<<"    "<<cue->name<<": reward_avg = "<<cue_extras[cue].reward_avg<<", times = "<<cue_extras[cue].times<<"\n";
+            for (int i = 0; i < count; i++)
+            {
+                RunTrial<true>(*trace);
+            }
         }
-        cout<<"\n";
+    }
+
+    void RefreshPolicies()
+    {
+        RefreshAllPolicies<ActorCritic>();
     }
 
 };
@@ -0,0 +1,119 @@
+#include <new>
+#include <cstdlib>
+
+#include "rl-config.h"
+#include "task-parser.h"
+
+// alloc-test [task.txt ...]
+// checks that a learner in steady state runs its trials without touching the heap: for every
+// learner, action selection policy and task (the three Morris tasks by default), on the full
+// graph and with compressed chains, runs warm-up trials, then counts the calls to operator new
+// over the trials after them. Prints one line per run and exits 1 if any of them allocated.
+// Built like the other tools: g++ -O2 -std=c++17 -pthread -o alloc-test alloc-test.cpp
+
+static long allocations = 0;
+
+// kept out of line -- inlined, gcc takes the free in delete for a mismatch with new
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == NULL)
+    {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+const int warm_up_trials = 1000;
+const int counted_trials = 10000;
+
+int main(int argc, char **argv)
+{
+    vector<string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        paths.push_back(argv[i]);
+    }
+    if (paths.empty())
+    {
+        paths.push_back("morris-trial.txt");
+        paths.push_back("morris-trial-delayed-reward.txt");
+        paths.push_back("morris-trial-delayed-reward-new.txt");
+    }
+
+    const LearnerType learners[] = {LEARNER_ACTOR_CRITIC, LEARNER_SARSA, LEARNER_Q_LEARNING};
+    const ActionSelectionMethod methods[] = {SOFTMAX, PROBABILITY_MATCHING, EPS_GREEDY};
+    const char *learner_names[] = {"ActorCritic", "SARSA", "QLearning"};
+    const char *method_names[] = {"SOFTMAX", "PROBABILITY_MATCHING", "EPS_GREEDY"};
+    int failures = 0;
+    for (int p = 0; p < paths.size(); p++)
+    {
+        ExperimentalModel *model = new ExperimentalModel();
+        TaskError error;
+        if (!ReadTaskFile(model, paths[p], error))
+        {
+            cerr<<error.ToString()<<"\n";
+            return 1;
+        }
+        if (allocations == 0)
+        {
+            cerr<<"operator new is not being counted.\n";
+            return 1;
+        }
+        for (int l = 0; l < 3; l++)
+        {
+            for (int m = 0; m < 3; m++)
+            {
+                for (int compress = 0; compress < 2; compress++)
+                {
+                    RLConfig config;
+                    config.learner = learners[l];
+                    config.method = methods[m];
+                    config.compress_chains = compress;
+                    if (config.compress_chains && model->CompressChains(config.gamma) == NULL)
+                    {
+                        continue;
+                    }
+                    RLMethod *rl_method = CreateRLMethod(model, config);
+                    rl_method->RunTrials(warm_up_trials);
+                    long before = allocations;
+                    rl_method->RunTrials(counted_trials);
+                    long count = allocations - before;
+                    delete rl_method;
+
+                    cout<<(count == 0 ? "ok   " : "FAIL ")<<paths[p]<<" "<<learner_names[l]<<" "<<method_names[m]<<(compress ? " compressed" : "");
+                    cout<<": "<<count<<" allocations in "<<counted_trials<<" trials\n";
+                    failures += count != 0;
+                }
+            }
+        }
+        delete model;
+    }
+    return failures == 0 ? 0 : 1;
+}
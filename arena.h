@@ -0,0 +1,156 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// monotonic arena -- memory is handed out from a few large blocks and only ever freed all at once
+// objects placed in it are never destroyed, so they must not own anything outside of it
+// (names are copied in with Copy, containers take an ArenaAllocator)
+class Arena
+{
+private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    vector<char*> blocks;
+    char *next;       // free space of the current block is [next, block_end)
+    char *block_end;
+    size_t block_size; // size of the next block; doubles up to max_block_size
+    size_t used;
+
+    static const size_t min_block_size = 64 << 10;
+    static const size_t max_block_size = 64 << 20;
+
+    void Grow(size_t size, size_t align)
+    {
+        size_t needed = size + align;
+        size_t size_to_get = block_size;
+        while (size_to_get < needed)
+        {
+            size_to_get *= 2;
+        }
+        char *block = (char*)malloc(size_to_get);
+        if (block == NULL)
+        {
+            throw bad_alloc();
+        }
+        blocks.push_back(block);
+        next = block;
+        block_end = block + size_to_get;
+        if (block_size < max_block_size)
+        {
+            block_size *= 2;
+        }
+    }
+
+public:
+    Arena() :
+        next(NULL),
+        block_end(NULL),
+        block_size(min_block_size),
+        used(0)
+    { }
+
+    ~Arena()
+    {
+        for (int i = 0; i < blocks.size(); i++)
+        {
+            free(blocks[i]);
+        }
+    }
+
+    void* Allocate(size_t size, size_t align = alignof(max_align_t))
+    {
+        size_t pad = (align - (size_t)next % align) % align;
+        if (next == NULL || pad + size > (size_t)(block_end - next))
+        {
+            Grow(size, align);
+            pad = (align - (size_t)next % align) % align;
+        }
+        char *result = next + pad;
+        next = result + size;
+        used += size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T* New(Args&&... args)
+    {
+        return new (Allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+    }
+
+    // a copy of s that lives as long as the arena
+    string_view Copy(string_view s)
+    {
+        if (s.empty())
+        {
+            return string_view();
+        }
+        char *chars = (char*)Allocate(s.size(), 1);
+        memcpy(chars, s.data(), s.size());
+        return string_view(chars, s.size());
+    }
+
+    size_t BytesUsed() const
+    {
+        return used;
+    }
+
+    int NumBlocks() const
+    {
+        return blocks.size();
+    }
+};
+
+
+// lets standard containers take their memory from an Arena; deallocation is a no-op
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    Arena *arena;
+
+    explicit ArenaAllocator(Arena *owner) :
+        arena(owner)
+    { }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) :
+        arena(other.arena)
+    { }
+
+    T* allocate(size_t n)
+    {
+        return (T*)arena->Allocate(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T*, size_t)
+    { }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const
+    {
+        return arena != other.arena;
+    }
+};
+
+template <typename T>
+using ArenaVector = vector<T, ArenaAllocator<T> >;
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef CHAIN_COMPRESSION_H
+#define CHAIN_COMPRESSION_H
+
+#include <vector>
+
+#include "compiled-model.h"
+
+using namespace std;
+
+// a chain state is one a trial always leaves the same way and that nothing is measured at:
+// a PROBABILISTIC, non-cue, non-terminal state with exactly one out-edge
+// (reward-25 -> reward-25-real, pre-start -> start, get-juice -> end, the wait states, ...)
+inline bool IsChainState(const CompiledModel &graph, int state)
+{
+    return graph.type[state] == PROBABILISTIC && graph.cue[state] == -1 && graph.OutDegree(state) == 1 && !graph.terminal[state];
+}
+
+
+// fold every run of chain states into the edges leading into it
+//
+// the compressed graph keeps all other states (in the same relative order) and has one
+// macro-edge per out-edge of a kept state. A macro-edge that passes through k original edges
+//   u -> v1 -> ... -> v(k-1) -> w
+// goes straight from u to w, with
+//   reward       = r(v1) + gamma r(v2) + ... + gamma^(k-1) r(w)  -- what TD sees
+//   discount     = gamma^k                                        -- on the value of w
+//   chain_reward = r(v1) + ... + r(v(k-1))                        -- what the cue bookkeeping sees
+// so a TD step over it is exactly the k steps of the original with the values of the chain
+// states at their fixed point. origin_edges lists the original edges of every macro-edge,
+// so RLMethod::ExpandChains can put the tables back on the original graph.
+// Returns false (and leaves compressed alone) if some chain loops back on itself.
+inline bool CompressChains(const CompiledModel &graph, double gamma, CompiledModel &compressed)
+{
+    int N = graph.num_states;
+    vector<char> chain(N);
+    for (int state = 0; state < N; state++)
+    {
+        chain[state] = IsChainState(graph, state);
+    }
+    if (graph.start_states.size() > 1)
+    {
+        // trials can start at any of them, so they all have to stay
+        for (int i = 0; i < graph.start_states.size(); i++)
+        {
+            chain[graph.start_states[i]] = 0;
+        }
+    }
+    vector<int> state_map(N, -1);
+    vector<int> kept;
+    for (int state = 0; state < N; state++)
+    {
+        if (!chain[state])
+        {
+            state_map[state] = kept.size();
+            kept.push_back(state);
+        }
+    }
+
+    CompiledModel result;
+    result.num_states = kept.size();
+    result.num_cues = graph.num_cues;
+    result.expanded_from = &graph;
+    result.chain_gamma = gamma;
+
+    // every trial starts by walking the chain out of the original start, if there is one
+    int start = graph.start;
+    while (start != -1 && chain[start])
+    {
+        int e = graph.OutBegin(start);
+        result.start_chain.push_back(e);
+        if (result.start_chain.size() > N)
+        {
+            return false;
+        }
+        start = graph.edges[e].to;
+    }
+
+    result.out_begin.push_back(0);
+    result.origin_begin.push_back(0);
+    vector<int> macro_from_edge(graph.num_transitions, -1); // first original edge -> macro-edge
+    for (int i = 0; i < kept.size(); i++)
+    {
+        int state = kept[i];
+        result.type.push_back(graph.type[state]);
+        result.reward.push_back(graph.reward[state]);
+        result.cue.push_back(graph.cue[state]);
+        result.state_name.push_back(graph.state_name[state]);
+        result.state_extra.push_back(graph.state_extra[state]);
+        result.state_origin.push_back(state);
+        for (int e = graph.OutBegin(state); e < graph.OutEnd(state); e++)
+        {
+            Edge edge = graph.edges[e];
+            double reward = edge.reward;
+            double discount = gamma;
+            double chain_reward = 0;
+            int steps = 1;
+            result.origin_edges.push_back(e);
+            while (chain[edge.to])
+            {
+                int next = graph.OutBegin(edge.to);
+                chain_reward += graph.reward[edge.to];
+                reward += discount * graph.edges[next].reward;
+                discount *= gamma;
+                result.origin_edges.push_back(next);
+                if (++steps > N)
+                {
+                    return false;
+                }
+                edge.to = graph.edges[next].to;
+            }
+            macro_from_edge[e] = result.edges.size();
+            edge.to = state_map[edge.to];
+            edge.reward = reward;
+            result.edges.push_back(edge);
+            result.edge_from.push_back(i);
+            result.discount.push_back(discount);
+            result.chain_reward.push_back(chain_reward);
+            result.origin_begin.push_back(result.origin_edges.size());
+        }
+        result.out_begin.push_back(result.edges.size());
+    }
+    result.num_transitions = result.edges.size();
+    vector<int> starts, terminals;
+    if (start != -1)
+    {
+        starts.push_back(state_map[start]);
+    }
+    else
+    {
+        for (int i = 0; i < graph.start_states.size(); i++)
+        {
+            starts.push_back(state_map[graph.start_states[i]]);
+        }
+    }
+    for (int i = 0; i < kept.size(); i++)
+    {
+        if (graph.terminal[kept[i]])
+        {
+            terminals.push_back(i);
+        }
+    }
+    result.SetEndpoints(starts, terminals);
+
+    // in-edges -- counting sort of the edges by target
+    result.in_begin.assign(result.num_states + 1, 0);
+    for (int e = 0; e < result.num_transitions; e++)
+    {
+        result.in_begin[result.edges[e].to + 1]++;
+    }
+    for (int i = 0; i < result.num_states; i++)
+    {
+        result.in_begin[i + 1] += result.in_begin[i];
+    }
+    result.in_edges.resize(result.num_transitions);
+    vector<int> in_next(result.in_begin.begin(), result.in_begin.end() - 1);
+    for (int e = 0; e < result.num_transitions; e++)
+    {
+        result.in_edges[in_next[result.edges[e].to]++] = e;
+    }
+
+    result.cue_states_begin.push_back(0);
+    for (int cue = 0; cue < graph.num_cues; cue++)
+    {
+        for (int j = graph.cue_states_begin[cue]; j < graph.cue_states_begin[cue + 1]; j++)
+        {
+            result.cue_states.push_back(state_map[graph.cue_states[j]]); // cue states are never folded
+        }
+        result.cue_states_begin.push_back(result.cue_states.size());
+    }
+    result.cue_value = graph.cue_value;
+    result.cue_name = graph.cue_name;
+    result.cue_index = graph.cue_index;
+    result.action_name = graph.action_name;
+
+    for (int i = 0; i < graph.state_order.size(); i++)
+    {
+        if (state_map[graph.state_order[i]] != -1)
+        {
+            result.state_order.push_back(state_map[graph.state_order[i]]);
+        }
+    }
+    for (int i = 0; i < graph.transition_order.size(); i++)
+    {
+        if (macro_from_edge[graph.transition_order[i]] != -1)
+        {
+            result.transition_order.push_back(macro_from_edge[graph.transition_order[i]]);
+        }
+    }
+
+    result.IndexRewardCues();
+    result.BuildAliasTables();
+    compressed = result;
+    return true;
+}
+
+#endif
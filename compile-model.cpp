@@ -0,0 +1,37 @@
+#include "model-file.h"
+
+// compile-model task.txt [model.acm]
+// compiles a task file into a model file (task.txt.acm by default) that LoadModelCached
+// and ModelFile can map without parsing
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        cerr<<"Usage: "<<argv[0]<<" task.txt [model.acm]\n";
+        return 1;
+    }
+    string task_path = argv[1];
+    string model_path = argc > 2 ? argv[2] : task_path + ".acm";
+
+    MappedFile text;
+    if (!text.Open(task_path))
+    {
+        cerr<<task_path<<": cannot read the task file\n";
+        return 1;
+    }
+    ExperimentalModel *model = new ExperimentalModel();
+    TaskParser parser(text.data, text.size, task_path);
+    TaskError error;
+    if (!parser.Parse(model, error))
+    {
+        cerr<<error.ToString()<<"\n";
+        return 1;
+    }
+    if (!WriteModelFile(model->graph, HashBytes(text.data, text.size), model_path))
+    {
+        cerr<<"Cannot write model file '"<<model_path<<"'.\n";
+        return 1;
+    }
+    cout<<model_path<<": "<<model->graph.num_states<<" states, "<<model->graph.num_transitions<<" transitions, "<<model->graph.num_cues<<" cues\n";
+    return 0;
+}
@@ -0,0 +1,311 @@
+#ifndef COMPILED_MODEL_H
+#define COMPILED_MODEL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cassert>
+#include <string_view>
+
+#include "name-pool.h"
+
+using namespace std;
+
+enum StateType
+{
+    PROBABILISTIC,
+    DETERMINISTIC,
+};
+
+
+enum TransitionType
+{
+    CHANCE, // out of a PROBABILISTIC state -- carries a probability
+    CHOICE  // out of a DETERMINISTIC state -- carries an action
+};
+
+
+// an outgoing edge in the compiled graph
+// kind always matches the type of the state it comes out of, so the hot loops
+// never need to look at it; the accessors check it in debug builds
+struct Edge
+{
+    int to;              // id of the target state
+    TransitionType kind;
+    double reward;       // reward of the target state
+    union
+    {
+        double probability; // CHANCE only
+        int action;         // CHOICE only -- id into action_name
+    };
+
+    double Probability() const
+    {
+        assert(kind == CHANCE);
+        return probability;
+    }
+
+    int Action() const
+    {
+        assert(kind == CHOICE);
+        return action;
+    }
+};
+
+
+// compiled, immutable view of an ExperimentalModel
+// states are numbered 0..N-1 in topological order (so a trial walks forward through memory),
+// transitions are numbered 0..T-1 by their position in the CSR edge array,
+// cues keep their input order (Morris relies on it)
+class CompiledModel
+{
+public:
+    int num_states;
+    int num_transitions;
+    int num_cues;
+
+    // hot -- touched on every step of a trial
+    vector<int> out_begin;     // out-edges of state s are edges[out_begin[s] .. out_begin[s + 1])
+    vector<Edge> edges;
+    vector<StateType> type;
+    vector<double> reward;
+    vector<int> cue;           // cue id of each state, or -1 for non-cue states
+
+    vector<int> start_states; // a trial starts in one of these, drawn uniformly
+    vector<char> terminal;    // by state id; a trial ends as soon as it gets to a terminal state
+    int start; // the start state if there is just one, -1 otherwise
+    int end;   // the terminal state if there is just one, -1 otherwise
+
+    // Walker/Vose alias tables for PROBABILISTIC states, one slot per out-edge
+    // (chance probabilities never change after Read, so they are built once)
+    vector<double> alias_threshold; // by transition id
+    vector<int> alias;              // by transition id -- the edge taken when the slot's threshold is not met
+
+    // cold -- used for bookkeeping, printing and the figures
+    vector<int> edge_from;     // origin state of each edge
+    vector<int> in_begin;      // in-edges of state s are in_edges[in_begin[s] .. in_begin[s + 1])
+    vector<int> in_edges;      // transition ids, grouped by target state
+    vector<int> cue_states_begin; // states of cue c are cue_states[cue_states_begin[c] .. cue_states_begin[c + 1])
+    vector<int> cue_states;
+    vector<double> cue_value;
+    vector<string> state_name;
+    vector<string> state_extra;
+    vector<string> cue_name;
+    vector<string> action_name;
+    PerfectHash cue_index;     // over cue_name
+
+    // what the figures read out of state_extra, resolved once by IndexRewardCues:
+    // the extra of a reward state is the name of the reference cue whose payoff it stands for
+    vector<int> reward_cue;       // by state; the reference cue a reward state pays for, or -1
+    vector<char> reference_cue;   // by cue; 1 if some reward state pays for it
+    vector<int> cue_edges_begin;  // edges into the reward states of cue c are
+    vector<int> cue_edges;        //   cue_edges[cue_edges_begin[c] .. cue_edges_begin[c + 1]), in input order
+
+    vector<int> state_order;      // state ids in input order
+    vector<int> transition_order; // transition ids in input order
+
+    // chain compression (chain-compression.h) -- only set on a compressed graph
+    const CompiledModel *expanded_from; // the graph this one was compressed from, or NULL
+    double chain_gamma;           // the discount factor the macro-edges were built for
+    vector<double> discount;      // by transition id; gamma^k for an edge that stands for k original edges
+    vector<double> chain_reward;  // by transition id; rewards of the states the edge skips over
+    vector<int> state_origin;     // by state id; the same state in expanded_from
+    vector<int> origin_begin;     // transition e stands for the edges origin_edges[origin_begin[e] .. origin_begin[e + 1])
+    vector<int> origin_edges;     //   of expanded_from, in the order they are taken
+    vector<int> start_chain;      // edges of expanded_from every trial takes before it gets to start
+
+    int OutBegin(int state) const
+    {
+        return out_begin[state];
+    }
+
+    int OutEnd(int state) const
+    {
+        return out_begin[state + 1];
+    }
+
+    int OutDegree(int state) const
+    {
+        return out_begin[state + 1] - out_begin[state];
+    }
+
+    int InDegree(int state) const
+    {
+        return in_begin[state + 1] - in_begin[state];
+    }
+
+    // pick an out-edge of a PROBABILISTIC state given a uniform draw u in [0, 1]
+    // returns -1 if the state has no out-edges
+    int SampleChance(int state, double u) const
+    {
+        int k = OutDegree(state);
+        if (k == 0)
+        {
+            return -1;
+        }
+        double x = u * k;
+        int slot = (int)x;
+        if (slot >= k)
+        {
+            slot = k - 1;
+        }
+        int e = out_begin[state] + slot;
+        return x - slot < alias_threshold[e] ? e : alias[e];
+    }
+
+    void BuildAliasTables()
+    {
+        alias_threshold.assign(num_transitions, 1);
+        alias.resize(num_transitions);
+        for (int e = 0; e < num_transitions; e++)
+        {
+            alias[e] = e;
+        }
+        vector<double> scaled;
+        vector<int> small, large;
+        for (int state = 0; state < num_states; state++)
+        {
+            int k = OutDegree(state);
+            if (type[state] != PROBABILISTIC || k == 0)
+            {
+                continue;
+            }
+            int begin = out_begin[state];
+            double total = 0;
+            for (int e = begin; e < begin + k; e++)
+            {
+                total += edges[e].Probability();
+            }
+            scaled.resize(k);
+            small.clear();
+            large.clear();
+            for (int i = 0; i < k; i++)
+            {
+                scaled[i] = edges[begin + i].Probability() * k / total;
+                if (scaled[i] < 1)
+                {
+                    small.push_back(i);
+                }
+                else
+                {
+                    large.push_back(i);
+                }
+            }
+            while (!small.empty() && !large.empty())
+            {
+                int s = small.back();
+                int l = large.back();
+                small.pop_back();
+                large.pop_back();
+                alias_threshold[begin + s] = scaled[s];
+                alias[begin + s] = begin + l;
+                scaled[l] -= 1 - scaled[s];
+                if (scaled[l] < 1)
+                {
+                    small.push_back(l);
+                }
+                else
+                {
+                    large.push_back(l);
+                }
+            }
+            // whatever is left over is 1 up to rounding
+            for (int i = 0; i < large.size(); i++)
+            {
+                alias_threshold[begin + large[i]] = 1;
+            }
+            for (int i = 0; i < small.size(); i++)
+            {
+                alias_threshold[begin + small[i]] = 1;
+            }
+        }
+    }
+
+    // set the states trials start and end in (start and end follow)
+    void SetEndpoints(const vector<int> &starts, const vector<int> &terminals)
+    {
+        start_states = starts;
+        terminal.assign(num_states, 0);
+        for (int i = 0; i < terminals.size(); i++)
+        {
+            terminal[terminals[i]] = 1;
+        }
+        start = starts.size() == 1 ? starts[0] : -1;
+        end = terminals.size() == 1 ? terminals[0] : -1;
+    }
+
+    // index cue_name for CueFromName -- once all cues are in
+    void IndexCues()
+    {
+        int duplicate = cue_index.Build(cue_name);
+        assert(duplicate == -1); // the readers turn down duplicate cue names
+        (void)duplicate;
+    }
+
+    int CueFromName(string_view name) const
+    {
+        return cue_index.Find(name, cue_name);
+    }
+
+    // resolve state_extra into reward_cue, reference_cue and cue_edges -- once the cues are
+    // indexed and transition_order is in
+    void IndexRewardCues()
+    {
+        reward_cue.resize(num_states);
+        reference_cue.assign(num_cues, 0);
+        for (int state = 0; state < num_states; state++)
+        {
+            reward_cue[state] = CueFromName(state_extra[state]);
+            if (reward_cue[state] != -1)
+            {
+                reference_cue[reward_cue[state]] = 1;
+            }
+        }
+        cue_edges_begin.assign(num_cues + 1, 0);
+        for (int e = 0; e < num_transitions; e++)
+        {
+            if (reward_cue[edges[e].to] != -1)
+            {
+                cue_edges_begin[reward_cue[edges[e].to] + 1]++;
+            }
+        }
+        for (int c = 0; c < num_cues; c++)
+        {
+            cue_edges_begin[c + 1] += cue_edges_begin[c];
+        }
+        cue_edges.resize(cue_edges_begin[num_cues]);
+        vector<int> cue_next(cue_edges_begin.begin(), cue_edges_begin.end() - 1);
+        for (int i = 0; i < transition_order.size(); i++)
+        {
+            int e = transition_order[i];
+            if (reward_cue[edges[e].to] != -1)
+            {
+                cue_edges[cue_next[reward_cue[edges[e].to]]++] = e;
+            }
+        }
+    }
+
+    // the reference cue a decision-trial edge -- one into a reward state from a state that does
+    // not show a reference cue -- pays for, or -1 for any other edge
+    int DecisionCue(int e) const
+    {
+        int from_cue = cue[edge_from[e]];
+        if (from_cue != -1 && reference_cue[from_cue])
+        {
+            return -1;
+        }
+        return reward_cue[edges[e].to];
+    }
+
+    CompiledModel() :
+        num_states(0),
+        num_transitions(0),
+        num_cues(0),
+        start(-1),
+        end(-1),
+        expanded_from(NULL),
+        chain_gamma(0)
+    { }
+};
+
+#endif
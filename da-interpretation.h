@@ -0,0 +1,36 @@
+#ifndef DA_INTERPRETATION_H
+#define DA_INTERPRETATION_H
+
+// how the dopamine response is read off the prediction errors
+// this decides which PE a transition is credited with in the bookkeeping (and thus the figures)
+enum DAInterpretation
+{
+    STANDARD_DA,
+    EXTENDED_DA
+};
+
+// standard interpretation -- a cue's response shows up on the transition out of the cue state,
+// everything else gets its own PE
+// this is a hack to make the plotting from the extended DA version work with the standard one
+struct StandardDA
+{
+    static const DAInterpretation interpretation = STANDARD_DA;
+
+    static double TransitionPE(bool from_cue_state, double PE, double PE_prev)
+    {
+        return from_cue_state ? PE_prev : PE;
+    }
+};
+
+// extended interpretation -- the response to a transition spans the PE before and after it
+struct ExtendedDA
+{
+    static const DAInterpretation interpretation = EXTENDED_DA;
+
+    static double TransitionPE(bool /*from_cue_state*/, double PE, double PE_prev)
+    {
+        return PE + PE_prev;
+    }
+};
+
+#endif
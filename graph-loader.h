@@ -0,0 +1,342 @@
+#ifndef GRAPH_LOADER_H
+#define GRAPH_LOADER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "model.h"
+#include "task-parser.h"
+#include "mapped-file.h"
+
+using namespace std;
+
+// the states trials start and end in, by name
+// an empty list means every state with no way in (starts) or no way out (terminals)
+struct GraphEndpoints
+{
+    vector<string> starts;
+    vector<string> terminals;
+};
+
+
+// reads a task file of any shape (mazes, gridworlds, ...) straight into a CompiledModel
+//
+// same format as TaskParser, but no ExperimentalModel is built on the way: the edge list is read
+// twice, once to count the out-degree of every state and once to put every edge into its slot of
+// the CSR array. Besides the graph itself, only a perfect hash over the state names (views into
+// the buffer) and a degree per state are held, and those go away with the loader.
+// States keep their input order rather than a topological one, since a general graph may have
+// cycles; transitions are numbered by CSR position as usual.
+class GraphLoader : public TaskScanner
+{
+private:
+    vector<string_view> state_keys; // by state id -- views into the buffer
+    PerfectHash state_index;        // over state_keys
+
+    string_view last_name; // edges tend to come grouped by origin, so the last lookup is kept
+    int last_id;
+
+    // the id of the state named by the current token
+    bool Lookup(int &id)
+    {
+        if (token == last_name)
+        {
+            id = last_id;
+            return true;
+        }
+        id = state_index.Find(token, state_keys);
+        if (id == -1)
+        {
+            return Fail("no state with name '" + string(token) + "' exists");
+        }
+        last_name = token;
+        last_id = id;
+        return true;
+    }
+
+    bool Endpoints(const vector<string> &names, vector<int> &ids, const char *what)
+    {
+        for (int i = 0; i < names.size(); i++)
+        {
+            int id = state_index.Find(names[i], state_keys);
+            if (id == -1)
+            {
+                error->file = file_name;
+                error->message = string("no state with name '") + names[i] + "' exists for a " + what;
+                return false;
+            }
+            ids.push_back(id);
+        }
+        return true;
+    }
+
+public:
+    GraphLoader(const char *data, size_t size, const string &name = "<graph>") :
+        TaskScanner(data, size, name),
+        last_id(-1)
+    { }
+
+    // on failure, err says where; graph is then partially filled and should be thrown away
+    bool Load(CompiledModel &graph, const GraphEndpoints &endpoints, TaskError &err)
+    {
+        error = &err;
+        err = TaskError();
+        graph = CompiledModel();
+
+        int C;
+        if (!Number(C, "the number of cues"))
+        {
+            return false;
+        }
+        if (C < 0)
+        {
+            return Fail("negative number of cues");
+        }
+        Mark cues_start = Here();
+        for (int i = 0; i < C; i++)
+        {
+            double value;
+            if (!Expect("a cue name"))
+            {
+                return false;
+            }
+            graph.cue_name.push_back(string(token));
+            if (!Number(value, "a cue value"))
+            {
+                return false;
+            }
+            graph.cue_value.push_back(value);
+        }
+        graph.num_cues = C;
+        int duplicate = graph.cue_index.Build(graph.cue_name);
+        if (duplicate != -1)
+        {
+            return FailAt(cues_start, 2, duplicate, "duplicate cue name '" + graph.cue_name[duplicate] + "'");
+        }
+
+        int N;
+        if (!Number(N, "the number of states"))
+        {
+            return false;
+        }
+        if (N < 0)
+        {
+            return Fail("negative number of states");
+        }
+        Mark states_start = Here();
+        state_keys.reserve(N);
+        graph.type.reserve(N);
+        graph.reward.reserve(N);
+        graph.cue.reserve(N);
+        graph.state_name.reserve(N);
+        graph.state_extra.reserve(N);
+        for (int i = 0; i < N; i++)
+        {
+            if (!Expect("a state name"))
+            {
+                return false;
+            }
+            state_keys.push_back(token);
+            graph.state_name.push_back(string(token));
+            double reward;
+            if (!Number(reward, "a state reward") || !Expect("a state type"))
+            {
+                return false;
+            }
+            graph.reward.push_back(reward);
+            graph.type.push_back(token[0] == 'D' || token[0] == 'd' ? DETERMINISTIC : PROBABILISTIC);
+            if (!Expect("a cue name"))
+            {
+                return false;
+            }
+            graph.cue.push_back(graph.CueFromName(token));
+            if (!Expect("the extra of a state"))
+            {
+                return false;
+            }
+            graph.state_extra.push_back(string(token));
+        }
+        graph.num_states = N;
+        duplicate = state_index.Build(state_keys);
+        if (duplicate != -1)
+        {
+            return FailAt(states_start, 5, duplicate, "duplicate state name '" + graph.state_name[duplicate] + "'");
+        }
+
+        // first pass over the edges -- check the names, count the degrees and keep the targets
+        // (in transition_order, which has room for one int per edge and is only filled in later)
+        Mark edges_start = Here();
+        vector<int> out_degree(N, 0), in_degree(N, 0);
+        long long T = 0;
+        int from, to;
+        while (Next())
+        {
+            if (!Lookup(from) || !Expect("the target state of a transition") || !Lookup(to))
+            {
+                return false;
+            }
+            if (!Expect(graph.type[from] == PROBABILISTIC ? "a transition probability" : "an action name"))
+            {
+                return false;
+            }
+            out_degree[from]++;
+            in_degree[to]++;
+            graph.transition_order.push_back(to);
+            T++;
+        }
+        if (T > 2000000000)
+        {
+            return Fail("too many transitions for int ids");
+        }
+        graph.num_transitions = T;
+
+        graph.out_begin.resize(N + 1);
+        graph.out_begin[0] = 0;
+        for (int i = 0; i < N; i++)
+        {
+            graph.out_begin[i + 1] = graph.out_begin[i] + out_degree[i];
+        }
+        graph.in_begin.resize(N + 1);
+        graph.in_begin[0] = 0;
+        for (int i = 0; i < N; i++)
+        {
+            graph.in_begin[i + 1] = graph.in_begin[i] + in_degree[i];
+        }
+
+        // second pass -- every edge straight into its slot (out_degree is reused as the fill count)
+        Rewind(edges_start);
+        graph.edges.resize(T);
+        graph.edge_from.resize(T);
+        graph.transition_order.shrink_to_fit();
+        fill(out_degree.begin(), out_degree.end(), 0);
+        PerfectHash action_index; // over graph.action_name, rebuilt for every new action (there are a handful)
+        for (int i = 0; i < T; i++)
+        {
+            // the first pass checked the names
+            Next();
+            Lookup(from);
+            Next();
+            to = graph.transition_order[i];
+            int slot = graph.out_begin[from] + out_degree[from]++;
+            Edge &edge = graph.edges[slot];
+            edge.to = to;
+            edge.reward = graph.reward[to];
+            if (graph.type[from] == PROBABILISTIC)
+            {
+                edge.kind = CHANCE;
+                if (!Number(edge.probability, "a transition probability"))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                edge.kind = CHOICE;
+                Next();
+                edge.action = action_index.Find(token, graph.action_name);
+                if (edge.action == -1)
+                {
+                    edge.action = graph.action_name.size();
+                    graph.action_name.push_back(string(token));
+                    action_index.Build(graph.action_name);
+                }
+            }
+            graph.edge_from[slot] = from;
+            graph.transition_order[i] = slot;
+        }
+
+        // in-edges -- counting sort of the edges by target
+        graph.in_edges.resize(T);
+        vector<int> &in_next = in_degree;
+        copy(graph.in_begin.begin(), graph.in_begin.end() - 1, in_next.begin());
+        for (int e = 0; e < T; e++)
+        {
+            graph.in_edges[in_next[graph.edges[e].to]++] = e;
+        }
+
+        // cue states -- counting sort of the states by cue
+        graph.cue_states_begin.assign(C + 1, 0);
+        for (int i = 0; i < N; i++)
+        {
+            if (graph.cue[i] != -1)
+            {
+                graph.cue_states_begin[graph.cue[i] + 1]++;
+            }
+        }
+        for (int c = 0; c < C; c++)
+        {
+            graph.cue_states_begin[c + 1] += graph.cue_states_begin[c];
+        }
+        graph.cue_states.resize(graph.cue_states_begin[C]);
+        vector<int> cue_next(graph.cue_states_begin.begin(), graph.cue_states_begin.end() - 1);
+        for (int i = 0; i < N; i++)
+        {
+            if (graph.cue[i] != -1)
+            {
+                graph.cue_states[cue_next[graph.cue[i]]++] = i;
+            }
+        }
+
+        graph.state_order.resize(N);
+        for (int i = 0; i < N; i++)
+        {
+            graph.state_order[i] = i;
+        }
+
+        vector<int> starts, terminals;
+        if (!Endpoints(endpoints.starts, starts, "start") || !Endpoints(endpoints.terminals, terminals, "terminal"))
+        {
+            return false;
+        }
+        for (int i = 0; i < N; i++)
+        {
+            if (endpoints.starts.empty() && graph.InDegree(i) == 0)
+            {
+                starts.push_back(i);
+            }
+            if (endpoints.terminals.empty() && graph.OutDegree(i) == 0)
+            {
+                terminals.push_back(i);
+            }
+        }
+        // a trial that got to a dead end would have no edge to take
+        vector<char> is_terminal(N, 0);
+        for (int i = 0; i < terminals.size(); i++)
+        {
+            is_terminal[terminals[i]] = 1;
+        }
+        for (int i = 0; i < N; i++)
+        {
+            if (graph.OutDegree(i) == 0 && !is_terminal[i])
+            {
+                return FailAt(states_start, 5, i, "state '" + graph.state_name[i] + "' has no way out but is not a terminal state");
+            }
+        }
+        graph.SetEndpoints(starts, terminals);
+
+        graph.IndexRewardCues();
+        graph.BuildAliasTables();
+        return true;
+    }
+};
+
+
+// read the graph at path into model->graph (the only part of model that is filled in,
+// as with a LoadModelCached hit -- which is all the learners use)
+inline bool LoadGraphFile(ExperimentalModel *model, const string &path, const GraphEndpoints &endpoints, TaskError &error)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = TaskError();
+        error.file = path;
+        error.message = "cannot read the graph file";
+        return false;
+    }
+    madvise((void*)file.data, file.size, MADV_SEQUENTIAL);
+    GraphLoader loader(file.data, file.size, path);
+    return loader.Load(model->graph, endpoints, error);
+}
+
+#endif
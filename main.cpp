@@ -1,37 +1,74 @@
 #include "morris.h"
-#include "actor-critic.h"
-#include "sarsa.h"
-#include "q-learning.h"
+#include "rl-config.h"
+#include "model-file.h"
 
-int main()
+// main [-c window] < task.txt -- or main [-c window] task.txt, which goes through the compiled model cache
+// with -c, the run stops early once the tables settle over windows of that many trials (RLMethod::RunTrials);
+// without it, all 300000 trials run
+int main(int argc, char **argv)
 {
+    string path;
+    int convergence_window = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg[0] != '-')
+        {
+            path = arg;
+        }
+        else if (arg == "-c" && i + 1 < argc)
+        {
+            convergence_window = atoi(argv[++i]);
+        }
+        else
+        {
+            cerr<<"Usage: "<<argv[0]<<" [-c window] [task.txt]\n";
+            return 1;
+        }
+    }
+
     // -------------------------------------------
     //                Read Experiment
     // -------------------------------------------
 
     ExperimentalModel *model = new ExperimentalModel();
     
-    model->Read();
+    TaskError error;
+    bool ok = !path.empty() ? LoadModelCached(model, path, error) : ReadTaskStream(model, cin, error, &cout);
+    if (!ok)
+    {
+        cerr<<error.ToString()<<"\n";
+        return 1;
+    }
     model->Print();
 
     // -------------------------------------------
     //                Simulate Experiment
     // -------------------------------------------
 
-    RLMethod *rl_method = new SARSA(
-        model, 
-        /* eta = critic learning rate */ 0.01,
-        /* alpha = actor learning rate */ 0.005,
-        /* gamma = discount factor */ 1, // clean = 1, real = 0.99
-        /* action selection method */ SOFTMAX, 
-        /* beta = softmax temperature */ 0.01,
-        /* min_R = minimum action reward */ 0.1,
-        /* noise = fraction of wrong button presses */ 0, // clean = 0, real = 0.1
-        /* eps = epsilon constant for eps-greedy action selection */ 0.01);
-
-    for (int i = 0; i < 300000; i++)
+    RLConfig config;
+    config.learner = LEARNER_SARSA;
+    config.eta = 0.01; // critic learning rate
+    config.alpha = 0.005; // actor learning rate
+    config.gamma = 1; // discount factor; clean = 1, real = 0.99
+    config.method = SOFTMAX; // action selection method
+    config.interpretation = STANDARD_DA; // how PEs are credited to transitions (actor-critic only)
+    config.beta = 0.01; // softmax temperature
+    config.min_R = 0.1; // minimum action reward
+    config.noise = 0; // fraction of wrong button presses; clean = 0, real = 0.1
+    config.eps = 0.01; // epsilon constant for eps-greedy action selection
+    RLMethod *rl_method = CreateRLMethod(model, config);
+
+    RunOptions options;
+    options.trace_last = 19; // print the steps of the last few trials
+    options.trace = &cout;
+    options.convergence.window = convergence_window; // 0 -- off; else stop once the tables stay put from one window to the next
+    options.convergence.tolerance = 0.5;
+    options.convergence.relative_tolerance = 0.01;
+    rl_method->RunTrials(300000, options);
+    if (rl_method->ConvergedAt() != -1)
     {
-        rl_method->Trial(/* do_print */ i > 299980);
+        cout<<"% converged after "<<rl_method->ConvergedAt()<<" trials\n";
     }
     rl_method->Print();
 
@@ -0,0 +1,123 @@
+#include <fstream>
+#include <chrono>
+#include <sys/resource.h>
+
+#include "task-generator.h"
+#include "rl-config.h"
+
+// make-task [-k levels] [-d delay] [-n fan-out] [-p both|high-left|high-right] [-r reference-fraction] [-b trials] [task.txt]
+// writes a generated Morris-style task (to stdout without a file name); with -b it instead runs
+// that many SARSA trials on it in memory and prints one line of size, speed and memory for plotting
+int main(int argc, char **argv)
+{
+    MorrisDesign design;
+    int bench_trials = 0;
+    string path;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg[0] != '-')
+        {
+            path = arg;
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            cerr<<"Option "<<arg<<" needs a value.\n";
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "-k")
+        {
+            design.levels = MorrisDesign::Uniform(atoi(value.c_str())).levels;
+        }
+        else if (arg == "-d")
+        {
+            design.delay = atoi(value.c_str());
+        }
+        else if (arg == "-n")
+        {
+            design.fan_out = atoi(value.c_str());
+        }
+        else if (arg == "-p")
+        {
+            if (value == "both")
+            {
+                design.placement = PLACE_BOTH_SIDES;
+            }
+            else if (value == "high-left")
+            {
+                design.placement = PLACE_HIGH_LEFT;
+            }
+            else if (value == "high-right")
+            {
+                design.placement = PLACE_HIGH_RIGHT;
+            }
+            else
+            {
+                cerr<<"Unknown placement '"<<value<<"'.\n";
+                return 1;
+            }
+        }
+        else if (arg == "-r")
+        {
+            design.reference_fraction = atof(value.c_str());
+        }
+        else if (arg == "-b")
+        {
+            bench_trials = atoi(value.c_str());
+        }
+        else
+        {
+            cerr<<"Usage: "<<argv[0]<<" [-k levels] [-d delay] [-n fan-out] [-p both|high-left|high-right] [-r reference-fraction] [-b trials] [task.txt]\n";
+            return 1;
+        }
+    }
+    string problem = design.Check();
+    if (!problem.empty())
+    {
+        cerr<<"Bad design: "<<problem<<".\n";
+        return 1;
+    }
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    ExperimentalModel *model = new ExperimentalModel();
+    GenerateMorrisTask(design, model);
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+
+    if (bench_trials == 0)
+    {
+        if (path.empty())
+        {
+            model->Write(cout);
+        }
+        else
+        {
+            ofstream out(path.c_str());
+            model->Write(out);
+            if (!out)
+            {
+                cerr<<"Cannot write task file '"<<path<<"'.\n";
+                return 1;
+            }
+        }
+        cerr<<model->graph.num_states<<" states, "<<model->graph.num_transitions<<" transitions, "<<model->graph.num_cues<<" cues\n";
+        return 0;
+    }
+
+    RLConfig config;
+    config.learner = LEARNER_SARSA;
+    RLMethod *rl_method = CreateRLMethod(model, config);
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+    rl_method->RunTrials(bench_trials);
+    chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double build_seconds = chrono::duration<double>(t1 - t0).count();
+    double run_seconds = chrono::duration<double>(t3 - t2).count();
+    cout<<"% states transitions cues build_s trials trials_per_s arena_bytes max_rss_kb\n";
+    cout<<model->graph.num_states<<" "<<model->graph.num_transitions<<" "<<model->graph.num_cues<<" "<<build_seconds<<" ";
+    cout<<bench_trials<<" "<<bench_trials / run_seconds<<" "<<model->arena.BytesUsed()<<" "<<usage.ru_maxrss<<"\n";
+    return 0;
+}
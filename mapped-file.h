@@ -0,0 +1,69 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// read-only mapping of a whole file; the pages are shared with every other process mapping it
+class MappedFile
+{
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    const char *data;
+    size_t size;
+
+    MappedFile() :
+        data(NULL),
+        size(0)
+    { }
+
+    bool Open(const string &path)
+    {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+        data = (const char*)mapping;
+        size = st.st_size;
+        return true;
+    }
+
+    void Close()
+    {
+        if (data != NULL)
+        {
+            munmap((void*)data, size);
+        }
+        data = NULL;
+        size = 0;
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+};
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef MEASUREMENT_H
+#define MEASUREMENT_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+#include "morris.h"
+
+using namespace std;
+
+// one number a figure plots, averaged over the measurement phase
+struct MeasuredStatistic
+{
+    string name;           // e.g. "2c 25 cue-25-L" or "4b 75-50 high"
+    double tolerance;      // the standard error the phase runs it down to
+    double mean;
+    double standard_error; // HUGE_VAL until there are enough looks to tell
+    vector<double> looks;  // its value at every look
+
+    MeasuredStatistic() :
+        tolerance(0),
+        mean(0),
+        standard_error(HUGE_VAL)
+    { }
+};
+
+
+// the measurement phase -- after learning, keeps running trials until every requested
+// statistic of the figures is known to within its tolerance, and says how precise each got
+//
+// every look_every trials the statistics are read off the figures (Morris) and each one's
+// estimate is the mean of its looks. Consecutive looks are correlated (the tables move slowly
+// and a PE only changes when its transition is taken), so the standard error comes from batch
+// means: the looks are cut into about sqrt(n) batches of about sqrt(n) looks each, which get
+// closer to independent as n grows.
+class Measurement
+{
+private:
+    RLMethod *learner;
+    ostringstream unused; // where Morris would print; only its numbers are read
+    Morris morris;
+    int look_every;
+    int min_looks;
+    vector<string> figures; // requested, in order
+    vector<MeasuredStatistic> statistics;
+    int trials_run;
+
+    // the current values of the requested figures, in the order of statistics
+    void Read(vector<string> &names, vector<double> &values)
+    {
+        for (int i = 0; i < figures.size(); i++)
+        {
+            if (figures[i] == "2c")
+            {
+                morris.Figure2cValues(names, values);
+            }
+            else
+            {
+                morris.Figure4bValues(names, values);
+            }
+        }
+    }
+
+    static void Estimate(MeasuredStatistic &statistic)
+    {
+        int n = statistic.looks.size();
+        int size = max((int)sqrt((double)n), 1);
+        int batches = n / size;
+        if (batches < 2)
+        {
+            statistic.mean = n > 0 ? accumulate(statistic.looks.begin(), statistic.looks.end(), 0.0) / n : 0;
+            statistic.standard_error = HUGE_VAL;
+            return;
+        }
+        // the first n % size looks are left out, so all batches are of one size
+        int first = n - batches * size;
+        vector<double> batch_mean(batches, 0);
+        double mean = 0;
+        for (int b = 0; b < batches; b++)
+        {
+            for (int i = 0; i < size; i++)
+            {
+                batch_mean[b] += statistic.looks[first + b * size + i];
+            }
+            batch_mean[b] /= size;
+            mean += batch_mean[b];
+        }
+        mean /= batches;
+        double variance = 0;
+        for (int b = 0; b < batches; b++)
+        {
+            variance += (batch_mean[b] - mean) * (batch_mean[b] - mean);
+        }
+        variance /= batches - 1;
+        statistic.mean = mean;
+        statistic.standard_error = sqrt(variance / batches);
+    }
+
+public:
+    Measurement(RLMethod *rl_method, double dopamine_bias = 75, int trials_per_look = 100, int minimum_looks = 100) :
+        learner(rl_method),
+        morris(rl_method, dopamine_bias, unused),
+        look_every(max(trials_per_look, 1)),
+        min_looks(minimum_looks),
+        trials_run(0)
+    { }
+
+    // whether Require knows figure
+    static bool Known(const string &figure)
+    {
+        return figure == "2c" || figure == "4b";
+    }
+
+    // measure every number figure plots ("2c" -- the PE of each reference cue state, or "4b" --
+    // the high and low PE of each decision cue) to a standard error of at most tolerance;
+    // false for a figure it does not know or already measures
+    bool Require(const string &figure, double tolerance)
+    {
+        if (!Known(figure) || find(figures.begin(), figures.end(), figure) != figures.end())
+        {
+            return false;
+        }
+        figures.push_back(figure);
+        vector<string> names;
+        vector<double> values;
+        Read(names, values);
+        for (int i = statistics.size(); i < names.size(); i++)
+        {
+            statistics.push_back(MeasuredStatistic());
+            statistics[i].name = names[i];
+            statistics[i].tolerance = tolerance;
+        }
+        return true;
+    }
+
+    // run trials, look_every at a time, until every statistic is precise enough or max_trials
+    // ran; returns how many trials ran. Can be called again to go on measuring.
+    int Run(int max_trials)
+    {
+        int done = 0;
+        int next_estimate = min_looks;
+        vector<string> names;
+        vector<double> values;
+        while (done < max_trials)
+        {
+            int count = min(look_every, max_trials - done);
+            learner->RunTrials(count);
+            done += count;
+            names.clear();
+            values.clear();
+            Read(names, values);
+            for (int i = 0; i < statistics.size(); i++)
+            {
+                statistics[i].looks.push_back(values[i]);
+            }
+            // the estimates are only redone every tenth more looks, which keeps the phase linear
+            int looks = statistics.empty() ? 0 : statistics[0].looks.size();
+            if (looks >= next_estimate)
+            {
+                for (int i = 0; i < statistics.size(); i++)
+                {
+                    Estimate(statistics[i]);
+                }
+                if (Precise())
+                {
+                    break;
+                }
+                next_estimate = looks + max(looks / 10, 1);
+            }
+        }
+        for (int i = 0; i < statistics.size(); i++)
+        {
+            Estimate(statistics[i]);
+        }
+        trials_run += done;
+        return done;
+    }
+
+    // whether every statistic is within its tolerance
+    bool Precise() const
+    {
+        for (int i = 0; i < statistics.size(); i++)
+        {
+            if (!(statistics[i].standard_error <= statistics[i].tolerance))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const vector<MeasuredStatistic>& Statistics() const
+    {
+        return statistics;
+    }
+
+    int TrialsRun() const
+    {
+        return trials_run;
+    }
+
+    // have morris plot the measured means in the figures they come from
+    void PlotMeasured(Morris &morris) const
+    {
+        for (int i = 0; i < statistics.size(); i++)
+        {
+            morris.PlotMeasured(statistics[i].name, statistics[i].mean);
+        }
+    }
+
+    // one comment line per statistic -- mean, standard error and the tolerance it was run to
+    void Print(ostream &out = cout)
+    {
+        int looks = statistics.empty() ? 0 : statistics[0].looks.size();
+        out<<"% measured over "<<trials_run<<" trials ("<<looks<<" looks)"<<(Precise() ? "" : ", not all statistics got to their tolerance")<<"\n";
+        for (int i = 0; i < statistics.size(); i++)
+        {
+            const MeasuredStatistic &statistic = statistics[i];
+            out<<"% "<<statistic.name<<" = "<<statistic.mean<<" +- "<<statistic.standard_error<<" (tolerance "<<statistic.tolerance<<")";
+            out<<(statistic.standard_error <= statistic.tolerance ? "" : " -- not reached")<<"\n";
+        }
+    }
+};
+
+#endif
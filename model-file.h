@@ -0,0 +1,653 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "model.h"
+#include "mapped-file.h"
+#include "task-parser.h"
+
+using namespace std;
+
+// binary file holding a CompiledModel, laid out so it can be mmap'ed and read without parsing:
+//
+//   ModelFileHeader
+//   section table -- one ModelFileSection per ModelFileSectionId, in that order
+//   sections      -- raw little-endian arrays, each starting on an 8-byte boundary
+//
+// name lists (state names, cues, ...) are string pools: count + 1 uint32 offsets into a
+// block of characters, so name i is chars[offsets[i] .. offsets[i + 1]).
+// source_hash is the hash of the task file the model was compiled from, and compiler_hash that
+// of what this build compiles a fixed probe task to (ModelCompilerHash); the cache below keys on
+// both, so a change to the compiler (state numbering, alias tables, ...) drops stale entries by
+// itself. Bump MODEL_FILE_VERSION whenever anything about the layout changes.
+// Edges are written with their unused payload bytes zeroed, so the same graph always gives the
+// same bytes.
+//
+// The file is read-only shared memory, but the graph is not: ModelFile::Load copies the sections
+// into the CompiledModel vectors, so every process that loads a model holds its own copy of the
+// tables. Sharing them across processes would take a CompiledModel that views the mapping
+// instead of owning vectors, and is out of scope here -- the cache saves the parse and compile.
+
+const char MODEL_FILE_MAGIC[8] = { 'A', 'C', 'M', 'O', 'D', 'E', 'L', 0 };
+const uint32_t MODEL_FILE_VERSION = 4;
+const uint32_t MODEL_FILE_BYTE_ORDER = 0x01020304;
+
+enum ModelFileSectionId
+{
+    SECTION_OUT_BEGIN,        // int32 [N + 1]
+    SECTION_EDGES,            // Edge [T]
+    SECTION_TYPE,             // int32 [N]
+    SECTION_REWARD,           // double [N]
+    SECTION_CUE,              // int32 [N]
+    SECTION_ALIAS_THRESHOLD,  // double [T]
+    SECTION_ALIAS,            // int32 [T]
+    SECTION_EDGE_FROM,        // int32 [T]
+    SECTION_IN_BEGIN,         // int32 [N + 1]
+    SECTION_IN_EDGES,         // int32 [T]
+    SECTION_CUE_STATES_BEGIN, // int32 [C + 1]
+    SECTION_CUE_STATES,       // int32 [cue_states_begin[C]]
+    SECTION_CUE_VALUE,        // double [C]
+    SECTION_STATE_ORDER,      // int32 [N]
+    SECTION_TRANSITION_ORDER, // int32 [T]
+    SECTION_STATE_NAME,       // string pool [N]
+    SECTION_STATE_EXTRA,      // string pool [N]
+    SECTION_CUE_NAME,         // string pool [C]
+    SECTION_ACTION_NAME,      // string pool [A]
+    SECTION_START_STATES,     // int32 [S]
+    SECTION_TERMINAL,         // uint8 [N]
+    NUM_SECTIONS
+};
+
+struct ModelFileSection
+{
+    uint64_t offset; // from the start of the file
+    uint64_t size;   // in bytes
+};
+
+struct ModelFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t edge_size; // sizeof(Edge) of the writer
+    uint32_t num_sections;
+    uint64_t source_hash;
+    uint64_t compiler_hash;
+    int32_t num_states;
+    int32_t num_transitions;
+    int32_t num_cues;
+    int32_t num_actions;
+    int32_t num_start_states;
+    int32_t padding;
+};
+
+
+class ModelFileWriter
+{
+private:
+    string body;
+    vector<ModelFileSection> sections;
+    uint64_t body_offset;
+
+    void Begin()
+    {
+        while (body.size() % 8 != 0)
+        {
+            body.push_back(0);
+        }
+        ModelFileSection section;
+        section.offset = body_offset + body.size();
+        section.size = 0;
+        sections.push_back(section);
+    }
+
+    void End()
+    {
+        sections.back().size = body_offset + body.size() - sections.back().offset;
+    }
+
+    void Append(const void *data, size_t size)
+    {
+        body.append((const char*)data, size);
+    }
+
+public:
+    ModelFileWriter() :
+        body_offset(sizeof(ModelFileHeader) + NUM_SECTIONS * sizeof(ModelFileSection))
+    { }
+
+    const string& Body() const
+    {
+        return body;
+    }
+
+    template <typename T>
+    void Array(const vector<T> &values)
+    {
+        Begin();
+        if (!values.empty())
+        {
+            Append(&values[0], values.size() * sizeof(T));
+        }
+        End();
+    }
+
+    // the payload of a CHOICE edge only fills the action, so each edge is copied over zeros
+    void Edges(const vector<Edge> &edges)
+    {
+        Begin();
+        for (int e = 0; e < edges.size(); e++)
+        {
+            Edge edge;
+            memset(&edge, 0, sizeof(edge));
+            edge.to = edges[e].to;
+            edge.kind = edges[e].kind;
+            edge.reward = edges[e].reward;
+            if (edge.kind == CHANCE)
+            {
+                edge.probability = edges[e].probability;
+            }
+            else
+            {
+                edge.action = edges[e].action;
+            }
+            Append(&edge, sizeof(edge));
+        }
+        End();
+    }
+
+    void Types(const vector<StateType> &types)
+    {
+        Begin();
+        for (int i = 0; i < types.size(); i++)
+        {
+            int32_t type = types[i];
+            Append(&type, sizeof(type));
+        }
+        End();
+    }
+
+    void Strings(const vector<string> &strings)
+    {
+        Begin();
+        uint32_t offset = 0;
+        for (int i = 0; i <= strings.size(); i++)
+        {
+            Append(&offset, sizeof(offset));
+            if (i < strings.size())
+            {
+                offset += strings[i].size();
+            }
+        }
+        for (int i = 0; i < strings.size(); i++)
+        {
+            Append(strings[i].data(), strings[i].size());
+        }
+        End();
+    }
+
+    bool Write(const ModelFileHeader &header, const string &path)
+    {
+        FILE *f = fopen(path.c_str(), "wb");
+        if (f == NULL)
+        {
+            return false;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = ok && fwrite(&sections[0], sizeof(ModelFileSection), sections.size(), f) == sections.size();
+        ok = ok && fwrite(body.data(), 1, body.size(), f) == body.size();
+        ok = fclose(f) == 0 && ok;
+        return ok;
+    }
+};
+
+
+// the sections of graph, in ModelFileSectionId order
+inline void WriteModelSections(const CompiledModel &graph, ModelFileWriter &writer)
+{
+    writer.Array(graph.out_begin);
+    writer.Edges(graph.edges);
+    writer.Types(graph.type);
+    writer.Array(graph.reward);
+    writer.Array(graph.cue);
+    writer.Array(graph.alias_threshold);
+    writer.Array(graph.alias);
+    writer.Array(graph.edge_from);
+    writer.Array(graph.in_begin);
+    writer.Array(graph.in_edges);
+    writer.Array(graph.cue_states_begin);
+    writer.Array(graph.cue_states);
+    writer.Array(graph.cue_value);
+    writer.Array(graph.state_order);
+    writer.Array(graph.transition_order);
+    writer.Strings(graph.state_name);
+    writer.Strings(graph.state_extra);
+    writer.Strings(graph.cue_name);
+    writer.Strings(graph.action_name);
+    writer.Array(graph.start_states);
+    writer.Array(graph.terminal);
+}
+
+
+// a small task with a bit of everything the compiler decides -- input order that is not the
+// topological one, unequal chance probabilities, choices, cues and reward-state extras
+const char MODEL_PROBE_TASK[] =
+    "3\n"
+    "A 10\n"
+    "B 20\n"
+    "A-B 15\n"
+    "7\n"
+    "end 0 probabilistic no-cue no-extra\n"
+    "reward-A 0 probabilistic no-cue A\n"
+    "start 0 probabilistic no-cue no-extra\n"
+    "cue-A 0 DETERMINISTIC A no-extra\n"
+    "cue-AB 0 DETERMINISTIC A-B no-extra\n"
+    "juice 5 probabilistic no-cue no-extra\n"
+    "reward-B 0 probabilistic no-cue B\n"
+    "start cue-A 0.6\n"
+    "start cue-AB 0.3\n"
+    "start end 0.1\n"
+    "cue-A reward-A left\n"
+    "cue-A end right\n"
+    "cue-AB reward-A left\n"
+    "cue-AB reward-B right\n"
+    "reward-A juice 0.7\n"
+    "reward-A end 0.3\n"
+    "reward-B juice 1\n"
+    "juice end 1\n";
+
+// the hash of what this build compiles MODEL_PROBE_TASK to -- it moves with any change to how
+// tasks are compiled that the probe shows, without anyone having to remember a version bump
+inline uint64_t ModelCompilerHash()
+{
+    static const uint64_t hash = []()
+    {
+        ExperimentalModel *probe = new ExperimentalModel();
+        TaskParser parser(MODEL_PROBE_TASK, strlen(MODEL_PROBE_TASK), "<probe>");
+        TaskError error;
+        bool ok = parser.Parse(probe, error);
+        assert(ok);
+        (void)ok;
+        ModelFileWriter writer;
+        WriteModelSections(probe->graph, writer);
+        uint64_t result = HashBytes(writer.Body().data(), writer.Body().size());
+        delete probe;
+        return result;
+    }();
+    return hash;
+}
+
+
+// write graph to path; goes through a temporary file and a rename, so processes racing to
+// fill the same cache entry never see a half-written file
+inline bool WriteModelFile(const CompiledModel &graph, uint64_t source_hash, const string &path)
+{
+    ModelFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.byte_order = MODEL_FILE_BYTE_ORDER;
+    header.edge_size = sizeof(Edge);
+    header.num_sections = NUM_SECTIONS;
+    header.source_hash = source_hash;
+    header.compiler_hash = ModelCompilerHash();
+    header.num_states = graph.num_states;
+    header.num_transitions = graph.num_transitions;
+    header.num_cues = graph.num_cues;
+    header.num_actions = graph.action_name.size();
+    header.num_start_states = graph.start_states.size();
+
+    ModelFileWriter writer;
+    WriteModelSections(graph, writer);
+
+    ostringstream tmp;
+    tmp<<path<<".tmp."<<getpid();
+    if (!writer.Write(header, tmp.str()))
+    {
+        remove(tmp.str().c_str());
+        return false;
+    }
+    if (rename(tmp.str().c_str(), path.c_str()) != 0)
+    {
+        remove(tmp.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// a mapped model file, checked against the layout this build expects and for ids out of range
+// the sections are read in place -- nothing is copied until Load
+class ModelFile
+{
+private:
+    MappedFile file;
+    const ModelFileHeader *header;
+    const ModelFileSection *sections;
+    string error;
+
+    bool Fail(const string &message)
+    {
+        error = message;
+        header = NULL;
+        sections = NULL;
+        return false;
+    }
+
+    bool CheckSection(int id, size_t count, size_t element_size)
+    {
+        const ModelFileSection &section = sections[id];
+        if (section.offset % 8 != 0 || section.offset > file.size || section.size > file.size - section.offset)
+        {
+            return false;
+        }
+        return section.size == count * element_size;
+    }
+
+    bool CheckStrings(int id, size_t count)
+    {
+        const ModelFileSection &section = sections[id];
+        if (section.offset % 8 != 0 || section.offset > file.size || section.size > file.size - section.offset)
+        {
+            return false;
+        }
+        size_t table_size = (count + 1) * sizeof(uint32_t);
+        if (section.size < table_size)
+        {
+            return false;
+        }
+        const uint32_t *offsets = Section<uint32_t>(id);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (offsets[i] > offsets[i + 1])
+            {
+                return false;
+            }
+        }
+        return offsets[0] == 0 && table_size + offsets[count] == section.size;
+    }
+
+    // an int32 section of count ids, each in [low, high)
+    bool CheckIds(int id, size_t count, int low, int high) const
+    {
+        const int32_t *ids = Section<int32_t>(id);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (ids[i] < low || ids[i] >= high)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // a CSR begin array of count + 1 entries: starts at 0 and never goes down
+    bool CheckOffsets(int id, size_t count) const
+    {
+        const int32_t *begin = Section<int32_t>(id);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (begin[i] > begin[i + 1])
+            {
+                return false;
+            }
+        }
+        return begin[0] == 0;
+    }
+
+    // each out-edge row against its state: the target and action in range, the kind matching
+    // the type, edge_from pointing back and the alias slot within the row
+    bool CheckEdges() const
+    {
+        const int32_t *out_begin = Section<int32_t>(SECTION_OUT_BEGIN);
+        const Edge *edges = Section<Edge>(SECTION_EDGES);
+        const int32_t *type = Section<int32_t>(SECTION_TYPE);
+        const int32_t *alias = Section<int32_t>(SECTION_ALIAS);
+        const int32_t *edge_from = Section<int32_t>(SECTION_EDGE_FROM);
+        for (int state = 0; state < header->num_states; state++)
+        {
+            if (type[state] != PROBABILISTIC && type[state] != DETERMINISTIC)
+            {
+                return false;
+            }
+            TransitionType kind = type[state] == PROBABILISTIC ? CHANCE : CHOICE;
+            int begin = out_begin[state], end = out_begin[state + 1];
+            for (int e = begin; e < end; e++)
+            {
+                const Edge &edge = edges[e];
+                if (edge.to < 0 || edge.to >= header->num_states || edge.kind != kind ||
+                    (kind == CHOICE && (edge.action < 0 || edge.action >= header->num_actions)) ||
+                    edge_from[e] != state || alias[e] < begin || alias[e] >= end)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    void CopySection(int id, vector<T> &values) const
+    {
+        const T *begin = Section<T>(id);
+        values.assign(begin, begin + sections[id].size / sizeof(T));
+    }
+
+    void CopyStrings(int id, vector<string> &strings) const
+    {
+        const uint32_t *offsets = Section<uint32_t>(id);
+        size_t count = StringCount(id);
+        const char *chars = (const char*)(offsets + count + 1);
+        strings.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            strings[i].assign(chars + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    }
+
+    size_t StringCount(int id) const
+    {
+        switch (id)
+        {
+            case SECTION_STATE_NAME:
+            case SECTION_STATE_EXTRA:
+                return header->num_states;
+            case SECTION_CUE_NAME:
+                return header->num_cues;
+            case SECTION_ACTION_NAME:
+                return header->num_actions;
+        }
+        return 0;
+    }
+
+public:
+    ModelFile() :
+        header(NULL),
+        sections(NULL)
+    { }
+
+    bool Open(const string &path)
+    {
+        if (!file.Open(path))
+        {
+            return Fail("cannot map '" + path + "'");
+        }
+        if (file.size < sizeof(ModelFileHeader) + NUM_SECTIONS * sizeof(ModelFileSection))
+        {
+            return Fail("'" + path + "' is too short to be a model file");
+        }
+        header = (const ModelFileHeader*)file.data;
+        sections = (const ModelFileSection*)(file.data + sizeof(ModelFileHeader));
+        if (memcmp(header->magic, MODEL_FILE_MAGIC, sizeof(header->magic)) != 0)
+        {
+            return Fail("'" + path + "' is not a model file");
+        }
+        if (header->version != MODEL_FILE_VERSION || header->byte_order != MODEL_FILE_BYTE_ORDER ||
+            header->edge_size != sizeof(Edge) || header->num_sections != NUM_SECTIONS)
+        {
+            return Fail("'" + path + "' was written for a different layout");
+        }
+        size_t N = header->num_states;
+        size_t T = header->num_transitions;
+        size_t C = header->num_cues;
+        if (header->num_states < 0 || header->num_transitions < 0 || header->num_cues < 0 || header->num_actions < 0 ||
+            !CheckSection(SECTION_OUT_BEGIN, N + 1, sizeof(int32_t)) ||
+            !CheckSection(SECTION_EDGES, T, sizeof(Edge)) ||
+            !CheckSection(SECTION_TYPE, N, sizeof(int32_t)) ||
+            !CheckSection(SECTION_REWARD, N, sizeof(double)) ||
+            !CheckSection(SECTION_CUE, N, sizeof(int32_t)) ||
+            !CheckSection(SECTION_ALIAS_THRESHOLD, T, sizeof(double)) ||
+            !CheckSection(SECTION_ALIAS, T, sizeof(int32_t)) ||
+            !CheckSection(SECTION_EDGE_FROM, T, sizeof(int32_t)) ||
+            !CheckSection(SECTION_IN_BEGIN, N + 1, sizeof(int32_t)) ||
+            !CheckSection(SECTION_IN_EDGES, T, sizeof(int32_t)) ||
+            !CheckSection(SECTION_CUE_STATES_BEGIN, C + 1, sizeof(int32_t)) ||
+            !CheckOffsets(SECTION_CUE_STATES_BEGIN, C) ||
+            !CheckSection(SECTION_CUE_STATES, Section<int32_t>(SECTION_CUE_STATES_BEGIN)[C], sizeof(int32_t)) ||
+            !CheckSection(SECTION_CUE_VALUE, C, sizeof(double)) ||
+            !CheckSection(SECTION_STATE_ORDER, N, sizeof(int32_t)) ||
+            !CheckSection(SECTION_TRANSITION_ORDER, T, sizeof(int32_t)) ||
+            !CheckStrings(SECTION_STATE_NAME, N) ||
+            !CheckStrings(SECTION_STATE_EXTRA, N) ||
+            !CheckStrings(SECTION_CUE_NAME, C) ||
+            !CheckStrings(SECTION_ACTION_NAME, header->num_actions) ||
+            header->num_start_states < 0 ||
+            !CheckSection(SECTION_START_STATES, header->num_start_states, sizeof(int32_t)) ||
+            !CheckSection(SECTION_TERMINAL, N, sizeof(char)))
+        {
+            return Fail("'" + path + "' is truncated or corrupt");
+        }
+        // every id in the file is used as an index unchecked once loaded, so a bad one is
+        // turned down here rather than read out of bounds later
+        if (!CheckOffsets(SECTION_OUT_BEGIN, N) || Section<int32_t>(SECTION_OUT_BEGIN)[N] != header->num_transitions ||
+            !CheckOffsets(SECTION_IN_BEGIN, N) || Section<int32_t>(SECTION_IN_BEGIN)[N] != header->num_transitions ||
+            !CheckEdges() ||
+            !CheckIds(SECTION_IN_EDGES, T, 0, T) ||
+            !CheckIds(SECTION_CUE, N, -1, C) ||
+            !CheckIds(SECTION_CUE_STATES, Section<int32_t>(SECTION_CUE_STATES_BEGIN)[C], 0, N) ||
+            !CheckIds(SECTION_STATE_ORDER, N, 0, N) ||
+            !CheckIds(SECTION_TRANSITION_ORDER, T, 0, T) ||
+            !CheckIds(SECTION_START_STATES, header->num_start_states, 0, N))
+        {
+            return Fail("'" + path + "' holds an id out of range");
+        }
+        error = "";
+        return true;
+    }
+
+    const ModelFileHeader& Header() const
+    {
+        return *header;
+    }
+
+    template <typename T>
+    const T* Section(int id) const
+    {
+        return (const T*)(file.data + sections[id].offset);
+    }
+
+    const string& Error() const
+    {
+        return error;
+    }
+
+    // fill graph from the mapped sections -- bulk copies into vectors of this process's own,
+    // on purpose (see the top of the file)
+    void Load(CompiledModel &graph) const
+    {
+        graph = CompiledModel();
+        graph.num_states = header->num_states;
+        graph.num_transitions = header->num_transitions;
+        graph.num_cues = header->num_cues;
+        CopySection(SECTION_OUT_BEGIN, graph.out_begin);
+        CopySection(SECTION_EDGES, graph.edges);
+        const int32_t *types = Section<int32_t>(SECTION_TYPE);
+        graph.type.resize(graph.num_states);
+        for (int i = 0; i < graph.num_states; i++)
+        {
+            graph.type[i] = (StateType)types[i];
+        }
+        CopySection(SECTION_REWARD, graph.reward);
+        CopySection(SECTION_CUE, graph.cue);
+        CopySection(SECTION_ALIAS_THRESHOLD, graph.alias_threshold);
+        CopySection(SECTION_ALIAS, graph.alias);
+        CopySection(SECTION_EDGE_FROM, graph.edge_from);
+        CopySection(SECTION_IN_BEGIN, graph.in_begin);
+        CopySection(SECTION_IN_EDGES, graph.in_edges);
+        CopySection(SECTION_CUE_STATES_BEGIN, graph.cue_states_begin);
+        CopySection(SECTION_CUE_STATES, graph.cue_states);
+        CopySection(SECTION_CUE_VALUE, graph.cue_value);
+        CopySection(SECTION_STATE_ORDER, graph.state_order);
+        CopySection(SECTION_TRANSITION_ORDER, graph.transition_order);
+        CopyStrings(SECTION_STATE_NAME, graph.state_name);
+        CopyStrings(SECTION_STATE_EXTRA, graph.state_extra);
+        CopyStrings(SECTION_CUE_NAME, graph.cue_name);
+        CopyStrings(SECTION_ACTION_NAME, graph.action_name);
+        vector<int> starts, terminals;
+        CopySection(SECTION_START_STATES, starts);
+        const char *terminal = Section<char>(SECTION_TERMINAL);
+        for (int i = 0; i < graph.num_states; i++)
+        {
+            if (terminal[i])
+            {
+                terminals.push_back(i);
+            }
+        }
+        graph.SetEndpoints(starts, terminals);
+        graph.IndexCues();
+        graph.IndexRewardCues();
+    }
+};
+
+
+// the compiled form of the task file at task_path, cached in cache_path (task_path + ".acm" by default)
+// the cache entry is used as long as it was compiled from a task file with the same contents,
+// by a compiler that compiles the probe task the same way;
+// otherwise the task file is read and compiled, and the cache entry rewritten.
+// Only model->graph is filled in when the cache hits -- which is all the learners and Morris use.
+// A task file that does not parse is reported through error.
+inline bool LoadModelCached(ExperimentalModel *model, const string &task_path, TaskError &error, string cache_path = "")
+{
+    if (cache_path.empty())
+    {
+        cache_path = task_path + ".acm";
+    }
+    MappedFile text;
+    if (!text.Open(task_path))
+    {
+        error = TaskError();
+        error.file = task_path;
+        error.message = "cannot read the task file";
+        return false;
+    }
+    uint64_t hash = HashBytes(text.data, text.size);
+
+    ModelFile cached;
+    if (cached.Open(cache_path) && cached.Header().source_hash == hash && cached.Header().compiler_hash == ModelCompilerHash())
+    {
+        cached.Load(model->graph);
+        return true;
+    }
+
+    TaskParser parser(text.data, text.size, task_path);
+    if (!parser.Parse(model, error))
+    {
+        return false;
+    }
+    if (!WriteModelFile(model->graph, hash, cache_path))
+    {
+        cerr<<"Cannot write model cache '"<<cache_path<<"'; continuing without it.\n";
+    }
+    return true;
+}
+
+#endif
@@ -8,35 +8,53 @@
 #include <cstring>
 #include <map>
 #include <sstream>
+#include <queue>
+#include <unordered_map>
+#include <cassert>
+#include <string_view>
+#include <charconv>
+
+#include "compiled-model.h"
+#include "chain-compression.h"
+#include "arena.h"
+#include "name-pool.h"
 
 using namespace std;
 
 class Cue;
 class Transition;
 
-enum StateType
+// x in as few digits as read back exactly -- for names and task files made by programs
+inline string NumberToString(double x)
 {
-    PROBABILISTIC,
-    DETERMINISTIC,
-};
+    char buffer[32];
+    to_chars_result result = to_chars(buffer, buffer + sizeof(buffer), x);
+    return string(buffer, result.ptr);
+}
 
+// the nodes and edges below live in the model's arena and are never destroyed --
+// their names point into the arena and their lists allocate from it
 
 class State
 {
 public:
-    string name;
+    string_view name; // ExperimentalModel::state_names.Name(name_id)
+    int name_id;      // id in ExperimentalModel::state_names -- also the position in states
     double reward;
     Cue *cue;
-    vector<Transition*> in, out;
+    ArenaVector<Transition*> in, out;
     StateType type;
-    string extra;
+    string_view extra;
+    int id; // id in the compiled graph
 
-    State() :
-        name(""),
+    State(Arena *arena) :
+        name_id(-1),
         reward(0),
         cue(NULL),
+        in(ArenaAllocator<Transition*>(arena)),
+        out(ArenaAllocator<Transition*>(arena)),
         type(PROBABILISTIC),
-        extra("")
+        id(-1)
     { }
 };
 
@@ -44,116 +62,115 @@ public:
 class Cue
 {
 public:
-    string name;
+    string_view name; // ExperimentalModel::cue_names.Name(name_id)
+    int name_id;      // id in ExperimentalModel::cue_names -- also the position in cues
     double value; // what is the expected reward for this cue -- this could be deduced from the graph, in theory
-    vector<State*> states;
-
-    Cue() :
-        name(""),
-        value(0)
+    ArenaVector<State*> states;
+    int id; // id in the compiled graph
+
+    Cue(Arena *arena) :
+        name_id(-1),
+        value(0),
+        states(ArenaAllocator<State*>(arena)),
+        id(-1)
     { }
 };
 
 
-enum TransitionType
-{
-    CHANCE,
-    CHOICE
-};
-
-
+// an edge of the task -- one plain struct for both kinds; the kind is always the one
+// implied by from->type (CHANCE out of PROBABILISTIC states, CHOICE out of DETERMINISTIC ones)
 class Transition
 {
 public:
     State *from;
     State *to;
-
-    Transition() :
-        from(NULL),
-        to(NULL)
-    { }
-
-    virtual string GetExtraString() = 0;
-};
-
-
-class Chance : public Transition
-{
-public:
-    double probability;
-
-    Chance() :
-        Transition(),
+    int id; // id in the compiled graph
+    TransitionType kind;
+    union
+    {
+        double probability; // CHANCE only
+        int action;         // CHOICE only -- name id in ExperimentalModel::action_names
+    };
+
+    Transition(State *from_state, State *to_state, TransitionType transition_kind) :
+        from(from_state),
+        to(to_state),
+        id(-1),
+        kind(transition_kind),
         probability(0)
     { }
 
-    string GetExtraString()
+    double Probability() const
     {
-       ostringstream ss;
-       ss<<"prob = "<<probability;
-       return ss.str();
+        assert(kind == CHANCE);
+        return probability;
     }
-};
 
-
-class Choice : public Transition
-{
-public:
-    string name;
-
-    Choice() :
-        Transition(),
-        name("")
-    { }
-
-    string GetExtraString()
+    int Action() const
     {
-        ostringstream ss;
-        ss<<"ACTION: "<<name;
-        return ss.str();
+        assert(kind == CHOICE);
+        return action;
     }
 };
 
 
 class ExperimentalModel
 {
+private:
+    ExperimentalModel(const ExperimentalModel&);
+    ExperimentalModel& operator=(const ExperimentalModel&);
+
 public:
+    Arena arena; // owns every Cue, State and Transition below
     vector<State*> states;
     vector<Transition*> transitions;
     vector<Cue*> cues;
 
-    map<string, State*> state_from_name;
-    map<string, Transition*> transition_from_name;
-    map<string, Cue*> cue_from_name;
+    // every name, interned once -- states and cues in input order (name id = position),
+    // actions in order of first appearance (name id = action id)
+    NamePool state_names;
+    NamePool cue_names;
+    NamePool action_names;
 
     State* start;
     State* end;
 
+    CompiledModel graph;
+    map<double, CompiledModel> chains; // graph with its chains compressed, by discount factor
+
     void Read()
+    {
+        Read(cin, &cout);
+    }
+
+    // read a task in the format of format.txt, echoing each state to echo unless it is NULL
+    void Read(istream &in, ostream *echo)
     {
         int C;
-        cin>>C;
+        in>>C;
         for (int i = 0; i < C; i++)
         {
-            Cue *cue = new Cue();
-            cin>>cue->name>>cue->value;
-            cues.push_back(cue);
-            if (cue_from_name.find(cue->name) != cue_from_name.end())
-            {
-                cerr<<"Duplicate cue name '"<<cue->name<<"'. Aborting...\n";
-                exit(0);
-            }
-            cue_from_name[cue->name] = cue;
+            string name;
+            in>>name;
+            AddCue(name);
+            in>>cues.back()->value;
+        }
+        int duplicate = cue_names.Build();
+        if (duplicate != -1)
+        {
+            cerr<<"Duplicate cue name '"<<cue_names.Name(duplicate)<<"'. Aborting...\n";
+            exit(0);
         }
 
         int N;
-        cin>>N;
+        in>>N;
         for (int i = 0; i < N; i++)
         {
-            State *state = new State();
-            string type;
-            string cue_name;
-            cin>>state->name>>state->reward>>type>>cue_name>>state->extra;
+            string name, type, cue_name, extra;
+            in>>name;
+            State *state = AddState(name);
+            in>>state->reward>>type>>cue_name>>extra;
+            state->extra = arena.Copy(extra);
             if (type[0] == 'D' or type[0] == 'd')
             {
                 state->type = DETERMINISTIC;
@@ -162,57 +179,102 @@ public:
             {
                 state->type = PROBABILISTIC;
             }
-            if (cue_from_name.find(cue_name) != cue_from_name.end())
+            int cue = cue_names.Find(cue_name);
+            if (cue != -1)
             {
-                Cue* cue = cue_from_name[cue_name];
-                state->cue = cue;
-                cue->states.push_back(state);
+                state->cue = cues[cue];
+                cues[cue]->states.push_back(state);
             }
-            states.push_back(state);
-            if (state_from_name.find(state->name) != state_from_name.end())
+            if (echo != NULL)
             {
-                cerr<<"Duplicate state name '"<<state->name<<"'. Aborting...\n";
-                exit(0);
+                *echo<<state->name<<" "<<state->reward<<" "<<state->type<<" "<<cue_name<<"\n";
             }
-            state_from_name[state->name] = state;
-            cout<<state->name<<" "<<state->reward<<" "<<state->type<<" "<<cue_name<<"\n";
+        }
+        duplicate = state_names.Build();
+        if (duplicate != -1)
+        {
+            cerr<<"Duplicate state name '"<<state_names.Name(duplicate)<<"'. Aborting...\n";
+            exit(0);
         }
 
         string from_name, to_name;
-        while (cin>>from_name>>to_name)
+        while (in>>from_name>>to_name)
         {
-            Transition *trans;
-            if (state_from_name.find(from_name) == state_from_name.end())
+            int from_id = state_names.Find(from_name);
+            if (from_id == -1)
             {
                 cerr<<"No state with name '"<<from_name<<"' exists. Aborting...\n";
                 exit(0);
             }
-            if (state_from_name.find(to_name) == state_from_name.end())
+            int to_id = state_names.Find(to_name);
+            if (to_id == -1)
             {
                 cerr<<"No state with name '"<<to_name<<"' exists. Aborting...\n";
                 exit(0);
             }
-            if (state_from_name[from_name]->type == PROBABILISTIC)
+            State *from = states[from_id];
+            State *to = states[to_id];
+            Transition *trans;
+            if (from->type == PROBABILISTIC)
             {
-                Chance *chance = new Chance();
-                chance->from = state_from_name[from_name];
-                chance->to = state_from_name[to_name];
-                cin>>chance->probability;
-                trans = chance;
+                trans = arena.New<Transition>(from, to, CHANCE);
+                in>>trans->probability;
             }
             else
             {
-                Choice *choice = new Choice();
-                choice->from = state_from_name[from_name];
-                choice->to = state_from_name[to_name];
-                cin>>choice->name;
-                trans = choice;
+                trans = arena.New<Transition>(from, to, CHOICE);
+                string name;
+                in>>name;
+                trans->action = ActionId(name);
             }
             transitions.push_back(trans);
             trans->from->out.push_back(trans);
             trans->to->in.push_back(trans);
         }
 
+        FindStartAndEnd();
+        Compile();
+    }
+
+
+    // a new cue (value 0) named name; cue_names has to be rebuilt before it can be found
+    Cue* AddCue(string_view name)
+    {
+        Cue *cue = arena.New<Cue>(&arena);
+        cue->name_id = cue_names.Add(name);
+        cue->name = cue_names.Name(cue->name_id);
+        cues.push_back(cue);
+        return cue;
+    }
+
+    // a new state (no cue, no reward) named name; state_names has to be rebuilt before it can be found
+    State* AddState(string_view name)
+    {
+        State *state = arena.New<State>(&arena);
+        state->name_id = state_names.Add(name);
+        state->name = state_names.Name(state->name_id);
+        states.push_back(state);
+        return state;
+    }
+
+
+    // the id of the action with the given name -- a new one the first time a name is seen
+    // (the index is rebuilt for every new action; tasks have a handful)
+    int ActionId(string_view name)
+    {
+        int id = action_names.Find(name);
+        if (id == -1)
+        {
+            id = action_names.Add(name);
+            action_names.Build();
+        }
+        return id;
+    }
+
+
+    // the start is the (last) state with no way in, the end the (last) state with no way out
+    void FindStartAndEnd()
+    {
         for (int i = 0; i < states.size(); i++)
         {
             State *state = states[i];
@@ -228,55 +290,261 @@ public:
     }
 
 
-    void Print()
+    // number everything and lay the graph out flat in graph
+    void Compile()
     {
-        cout<<" Cues:\n";
+        graph = CompiledModel();
+        graph.num_states = states.size();
+        graph.num_transitions = transitions.size();
+        graph.num_cues = cues.size();
+
+        // cues keep their input order
         for (int i = 0; i < cues.size(); i++)
         {
-            Cue* cue = cues[i];
-            cout<<"   "<<cue->name<<"  --> $"<<cue->value<<". States: ";
-            for (int j = 0; j < cue->states.size(); j++)
+            cues[i]->id = i;
+        }
+
+        // states -- topological order (Kahn), ties broken by input order
+        // (ids hold the input position until the order is known)
+        vector<int> in_degree(states.size());
+        vector<char> placed(states.size(), 0);
+        queue<State*> ready;
+        for (int i = 0; i < states.size(); i++)
+        {
+            State *state = states[i];
+            state->id = i;
+            in_degree[i] = state->in.size();
+            if (state->in.size() == 0)
             {
-                cout<<cue->states[j]->name<<", ";
+                ready.push(state);
             }
-            cout<<"\n";
         }
-        cout<<"\n States:\n";
+        vector<State*> order;
+        order.reserve(states.size());
+        while (!ready.empty())
+        {
+            State *state = ready.front();
+            ready.pop();
+            placed[state->id] = 1;
+            order.push_back(state);
+            for (int j = 0; j < state->out.size(); j++)
+            {
+                State *next = state->out[j]->to;
+                if (--in_degree[next->id] == 0)
+                {
+                    ready.push(next);
+                }
+            }
+        }
+        // states on a cycle have no topological order -- just append them
         for (int i = 0; i < states.size(); i++)
         {
-            State *state = states[i];
-            cout<<"   "<<state->name<<" --> $"<<state->reward<<". Cue: "<<(state->cue ? state->cue->name : "no-cue")<<". Type: "<<(state->type == PROBABILISTIC ? "probabilistic" : "DETERMINISTIC")<<", extra = "<<state->extra<<"\n";
+            if (!placed[i])
+            {
+                order.push_back(states[i]);
+            }
+        }
+        for (int i = 0; i < order.size(); i++)
+        {
+            order[i]->id = i;
+        }
+
+        // transitions -- numbered by their position in the CSR array
+        graph.out_begin.push_back(0);
+        for (int i = 0; i < order.size(); i++)
+        {
+            State *state = order[i];
+            graph.type.push_back(state->type);
+            graph.reward.push_back(state->reward);
+            graph.cue.push_back(state->cue ? state->cue->id : -1);
+            graph.state_name.push_back(string(state->name));
+            graph.state_extra.push_back(string(state->extra));
             for (int j = 0; j < state->out.size(); j++)
             {
-                Transition* trans = state->out[j];
-                cout<<"                                                               "<<trans->from->name<<" "<<trans->to->name<<" ("<<trans->GetExtraString()<<")\n";
+                Transition *trans = state->out[j];
+                trans->id = graph.edges.size();
+                Edge edge;
+                edge.to = trans->to->id;
+                edge.kind = trans->kind;
+                edge.reward = trans->to->reward;
+                if (trans->kind == CHANCE)
+                {
+                    edge.probability = trans->Probability();
+                }
+                else
+                {
+                    edge.action = trans->Action();
+                }
+                graph.edges.push_back(edge);
+                graph.edge_from.push_back(state->id);
             }
+            graph.out_begin.push_back(graph.edges.size());
+        }
+
+        // in-edges -- counting sort of the edges by target
+        graph.in_begin.assign(graph.num_states + 1, 0);
+        for (int e = 0; e < graph.edges.size(); e++)
+        {
+            graph.in_begin[graph.edges[e].to + 1]++;
+        }
+        for (int i = 0; i < graph.num_states; i++)
+        {
+            graph.in_begin[i + 1] += graph.in_begin[i];
+        }
+        graph.in_edges.resize(graph.edges.size());
+        vector<int> in_next(graph.in_begin.begin(), graph.in_begin.end() - 1);
+        for (int e = 0; e < graph.edges.size(); e++)
+        {
+            graph.in_edges[in_next[graph.edges[e].to]++] = e;
+        }
+
+        graph.cue_states_begin.push_back(0);
+        for (int i = 0; i < cues.size(); i++)
+        {
+            Cue *cue = cues[i];
+            graph.cue_value.push_back(cue->value);
+            graph.cue_name.push_back(string(cue->name));
+            for (int j = 0; j < cue->states.size(); j++)
+            {
+                graph.cue_states.push_back(cue->states[j]->id);
+            }
+            graph.cue_states_begin.push_back(graph.cue_states.size());
+        }
+
+        for (int i = 0; i < states.size(); i++)
+        {
+            graph.state_order.push_back(states[i]->id);
+        }
+        for (int i = 0; i < transitions.size(); i++)
+        {
+            graph.transition_order.push_back(transitions[i]->id);
+        }
+        for (int i = 0; i < action_names.Size(); i++)
+        {
+            graph.action_name.push_back(string(action_names.Name(i)));
+        }
+        graph.IndexCues();
+        graph.IndexRewardCues();
+        vector<int> starts, terminals;
+        if (start)
+        {
+            starts.push_back(start->id);
+        }
+        if (end)
+        {
+            terminals.push_back(end->id);
         }
-        cout<<"\n";
+        graph.SetEndpoints(starts, terminals);
+
+        graph.BuildAliasTables();
     }
 
 
-    ExperimentalModel() :
-        start(NULL),
-        end(NULL)
-    { }
+    // build graph with its deterministic chains folded into macro-edges for the given discount
+    // factor (see chain-compression.h); learners created with RLConfig::compress_chains run on it
+    // not thread-safe -- build every discount factor needed before the learners start
+    const CompiledModel* CompressChains(double gamma)
+    {
+        map<double, CompiledModel>::iterator it = chains.find(gamma);
+        if (it != chains.end())
+        {
+            return &it->second;
+        }
+        CompiledModel &compressed = chains[gamma];
+        if (!::CompressChains(graph, gamma, compressed))
+        {
+            chains.erase(gamma);
+            return NULL;
+        }
+        return &compressed;
+    }
 
+    // the compressed graph for gamma, or NULL if it was not built (or cannot be)
+    const CompiledModel* Chains(double gamma) const
+    {
+        map<double, CompiledModel>::const_iterator it = chains.find(gamma);
+        return it != chains.end() ? &it->second : NULL;
+    }
 
-    ~ExperimentalModel()
+
+    // printed from the compiled graph, so a model loaded from a model file prints the same
+    void Print(ostream &out = cout)
     {
-        for (int i = 0; i < states.size(); i++)
+        out<<" Cues:\n";
+        for (int cue = 0; cue < graph.num_cues; cue++)
         {
-            delete states[i];
+            out<<"   "<<graph.cue_name[cue]<<"  --> $"<<graph.cue_value[cue]<<". States: ";
+            for (int j = graph.cue_states_begin[cue]; j < graph.cue_states_begin[cue + 1]; j++)
+            {
+                out<<graph.state_name[graph.cue_states[j]]<<", ";
+            }
+            out<<"\n";
         }
-        for (int i = 0; i < transitions.size(); i++)
+        out<<"\n States:\n";
+        for (int i = 0; i < graph.num_states; i++)
         {
-            delete transitions[i];
+            int state = graph.state_order[i];
+            out<<"   "<<graph.state_name[state]<<" --> $"<<graph.reward[state]<<". Cue: "<<(graph.cue[state] != -1 ? graph.cue_name[graph.cue[state]] : "no-cue")<<". Type: "<<(graph.type[state] == PROBABILISTIC ? "probabilistic" : "DETERMINISTIC")<<", extra = "<<graph.state_extra[state]<<"\n";
+            for (int e = graph.OutBegin(state); e < graph.OutEnd(state); e++)
+            {
+                const Edge &edge = graph.edges[e];
+                out<<"                                                               "<<graph.state_name[state]<<" "<<graph.state_name[edge.to]<<" (";
+                if (edge.kind == CHANCE)
+                {
+                    out<<"prob = "<<edge.Probability();
+                }
+                else
+                {
+                    out<<"ACTION: "<<graph.action_name[edge.Action()];
+                }
+                out<<")\n";
+            }
         }
+        out<<"\n";
+    }
+
+
+    // the model in the format of format.txt, in input order -- Read reads it back into the same graph
+    void Write(ostream &out) const
+    {
+        out<<cues.size()<<"\n";
         for (int i = 0; i < cues.size(); i++)
         {
-            delete cues[i];
+            out<<cues[i]->name<<" "<<NumberToString(cues[i]->value)<<"\n";
+        }
+        out<<"\n"<<states.size()<<"\n";
+        for (int i = 0; i < states.size(); i++)
+        {
+            State *state = states[i];
+            out<<state->name<<" "<<NumberToString(state->reward)<<" "<<(state->type == PROBABILISTIC ? "probabilistic" : "DETERMINISTIC")<<" ";
+            out<<(state->cue ? state->cue->name : string_view("no-cue"))<<" "<<(state->extra.empty() ? string_view("no-extra") : state->extra)<<"\n";
+        }
+        out<<"\n";
+        for (int i = 0; i < transitions.size(); i++)
+        {
+            Transition *trans = transitions[i];
+            out<<trans->from->name<<" "<<trans->to->name<<" ";
+            if (trans->kind == CHANCE)
+            {
+                out<<NumberToString(trans->Probability())<<"\n";
+            }
+            else
+            {
+                out<<action_names.Name(trans->Action())<<"\n";
+            }
         }
     }
+
+
+    ExperimentalModel() :
+        start(NULL),
+        end(NULL)
+    { }
+
+
+    // nothing to delete one by one -- the arena frees everything in a few blocks
+    ~ExperimentalModel()
+    { }
 };
 
 #endif
@@ -11,7 +11,6 @@
 #include <cmath>
 #include <utility>
 #include <cassert>
-#include <set>
 
 #include "rl-method.h"
 
@@ -20,6 +19,10 @@ class Morris
 private:
     RLMethod *ac;
     double bias;
+    ostream &out; // where the figures go
+
+    // #hardcoded FIXME
+    static constexpr int figure_4b_cues[6] = {5, 7, 8, 9, 11, 12}; // the decision cues with distinct outcomes
     
     template<typename X, typename Y>
     void PrintFigure(
@@ -34,7 +37,7 @@ private:
         string ylabel,
         string extra_comands = "")
    {
-        cout<<"\n %% ------ Figure "<<name<<" ------\n\n";
+        out<<"\n %% ------ Figure "<<name<<" ------\n\n";
         char open_par = '[';
         char close_par = ']';
         if (plot_fn == "bar")
@@ -42,170 +45,318 @@ private:
             open_par = '{';
             close_par = '}';
         }
-        cout<<"x_"<<name<<" = "<<open_par;
+        out<<"x_"<<name<<" = "<<open_par;
         for (int i = 0; i < x.size(); i++)
         {
-            cout<<x[i]<<"; ";
+            out<<x[i]<<"; ";
         }
-        cout<<close_par<<";\n";
-        cout<<"y_"<<name<<" = [";
+        out<<close_par<<";\n";
+        out<<"y_"<<name<<" = [";
         for (int i = 0; i < y.size(); i++)
         {
-            cout<<y[i]<<"; ";
+            out<<y[i]<<"; ";
         }
-        cout<<"];\n";
-        cout<<"subplot("<<subplot_m<<","<<subplot_n<<","<<subplot_p<<");\n";
+        out<<"];\n";
+        out<<"subplot("<<subplot_m<<","<<subplot_n<<","<<subplot_p<<");\n";
         if (plot_fn == "bar")
         {
-            cout<<plot_fn<<"(y_"<<name<<");\n";
-            cout<<"set(gca, 'XTickLabel', x_"<<name<<");\n";
+            out<<plot_fn<<"(y_"<<name<<");\n";
+            out<<"set(gca, 'XTickLabel', x_"<<name<<");\n";
         }
         else
         {
-            cout<<plot_fn<<"(x_"<<name<<", y_"<<name<<");\n";
+            out<<plot_fn<<"(x_"<<name<<", y_"<<name<<");\n";
         }
-        cout<<"xlabel('"<<xlabel<<"');\n";
-        cout<<"ylabel('"<<ylabel<<"');\n";
-        cout<<extra_comands<<"\n";
-        cout<<"\n";
+        out<<"xlabel('"<<xlabel<<"');\n";
+        out<<"ylabel('"<<ylabel<<"');\n";
+        out<<extra_comands<<"\n";
+        out<<"\n";
     }
 
-    double GetAverageReferenceTrialRewardFromDecisionTrialAction(Transition* trans)
-    {
-        // get the corresponding reference trial cue
-        // from the type of reward that this action leads to
-        // FIXME this is a #HACK -- we just store the queue in the extra
-        // string of the reward state... super awk but that's the least
-        // annoying way I could come up with
-        Cue *ref_cue = ac->model->cue_from_name[trans->to->extra];
-        return ac->cue_extras[ref_cue].reward_avg;
-    }
+    // numbers to plot instead of the current ones, by the names Figure2cValues and Figure4bValues
+    // give them -- what a measurement phase averaged them to (PlotMeasured)
+    vector<pair<string, double> > measured;
 
-    double GetAveragePE(State *state)
+    double Plotted(const string &name, double current) const
     {
-        double PE_avg = 0;
-        int times_total = 0;
-        for (int j = 0; j < state->out.size(); j++)
+        for (int i = 0; i < measured.size(); i++)
         {
-            Transition *trans = state->out[j];
-            PE_avg += ac->transition_extras[trans].PE_avg * ac->transition_extras[trans].times;
-            times_total += ac->transition_extras[trans].times;
+            if (measured[i].first == name)
+            {
+                return measured[i].second;
+            }
         }
-        assert(times_total == ac->state_extras[state].times);
-        PE_avg /= ac->state_extras[state].times;
-        return PE_avg + bias;
+        return current;
     }
 
-    double GetAveragePE(Cue *cue)
+    // every PE average the figures read, built in one pass per version of the learner's
+    // statistics, each level from the one below it: edges, states, reward chains, cue states,
+    // cues. The sums are the ones the figures used to do one call at a time, in the same order.
+    long long aggregates_version; // the ac->stats_version they were built from, -1 for never
+    vector<double> state_PE;        // by cue state; average PE of its choices, plus bias
+    vector<double> rewarded_PE;     // by state; average PE of the rewarded edges at the end of its chain, plus bias
+    vector<double> children_PE;     // by cue state; rewarded_PE of the states its choices lead to
+    vector<double> cue_PE;          // by cue; state_PE of its states
+    vector<double> cue_children_PE; // by cue; children_PE of its states
+    vector<double> decision_PE;     // by reference cue; average PE of the decision-trial actions paid by it
+    vector<double> delivery_PE;     // by reference cue; rewarded_PE of the actions paid by it
+    // (all of the averages are weighted by how often each part was taken)
+
+    void BuildAggregates()
     {
-        double PE_avg = 0;
-        int times_total = 0;
-        for (int i = 0; i < cue->states.size(); i++)
+        const CompiledModel *graph = ac->graph;
+        const vector<RLMethod::TransitionExtra> &trans_extras = ac->transition_extras;
+        const vector<RLMethod::StateExtra> &state_extras = ac->state_extras;
+
+        // reward chains -- the delay before a reward (e.g. reward-25 --> wait --> wait -->
+        // reward-25-real --> juice or no-juice) is a run of states with a single way out, and
+        // every state on it gets the value of the state the run ends in
+        rewarded_PE.assign(graph->num_states, 0);
+        vector<char> known(graph->num_states, 0);
+        vector<int> path;
+        for (int state = 0; state < graph->num_states; state++)
         {
-            State *state = cue->states[i];
-            PE_avg += GetAveragePE(state) * ac->state_extras[state].times;
-            times_total += ac->state_extras[state].times;
+            path.clear();
+            int end = state;
+            // (a loop of single ways out never ends in anything, and stays at 0)
+            while (!known[end] && graph->OutDegree(end) == 1)
+            {
+                known[end] = 1;
+                path.push_back(end);
+                end = graph->edges[graph->OutBegin(end)].to;
+            }
+            if (!known[end])
+            {
+                known[end] = 1;
+                double PE_avg = 0;
+                int times = 0;
+                for (int trans = graph->OutBegin(end); trans < graph->OutEnd(end); trans++)
+                {
+                    if (graph->edges[trans].reward > 0)
+                    {
+                        PE_avg += trans_extras[trans].PE_avg * trans_extras[trans].times;
+                        times += trans_extras[trans].times;
+                    }
+                }
+                rewarded_PE[end] = times == 0 ? bias : PE_avg / times + bias;
+            }
+            for (int i = 0; i < path.size(); i++)
+            {
+                rewarded_PE[path[i]] = rewarded_PE[end];
+            }
         }
-        assert(times_total == ac->cue_extras[cue].times);
-        PE_avg /= ac->cue_extras[cue].times;
-        return PE_avg;
-    }
 
-    double GetAverageReferenceTrialPEFromDecisionTrialAction(Transition *trans)
-    {
-        // get the corresponding reference trial cue
-        // from the type of reward that this action leads to
-        // FIXME this is a #HACK -- we just store the queue in the extra
-        // string of the reward state... super awk but that's the least
-        // annoying way I could come up with
-        Cue *ref_cue = ac->model->cue_from_name[trans->to->extra];
-        return GetAveragePE(ref_cue);
-    }
-
-    double GetAveragePEForRewardedTransitionsFrom(State *state)
-    {
-        double PE_avg = 0;
-        int times = 0;
-        // FIXME this is a hack -- the reward is delayed (i.e. there are intermediate states,
-        // like reward-25 --> wait --> wait --> wait --> reward-25-real --> juice or no-juice
-        // we keep going until we hit the juice
-        while (state->out.size() == 1)
+        // cue states
+        state_PE.assign(graph->num_states, 0);
+        children_PE.assign(graph->num_states, 0);
+        for (int j = 0; j < graph->cue_states.size(); j++)
         {
-            state = state->out[0]->to;
+            int state = graph->cue_states[j];
+            double PE_avg = 0;
+            double children_PE_avg = 0;
+            int times_total = 0;
+            for (int trans = graph->OutBegin(state); trans < graph->OutEnd(state); trans++)
+            {
+                PE_avg += trans_extras[trans].PE_avg * trans_extras[trans].times;
+                children_PE_avg += rewarded_PE[graph->edges[trans].to] * trans_extras[trans].times;
+                times_total += trans_extras[trans].times;
+            }
+            assert(times_total == state_extras[state].times);
+            state_PE[state] = PE_avg / state_extras[state].times + bias;
+            children_PE[state] = times_total == 0 ? 0 : children_PE_avg / times_total;
         }
-        for (int i = 0; i < state->out.size(); i++)
+
+        // cues
+        cue_PE.assign(graph->num_cues, 0);
+        cue_children_PE.assign(graph->num_cues, 0);
+        for (int cue = 0; cue < graph->num_cues; cue++)
         {
-            Transition* trans = state->out[i];
-            if (trans->to->reward > 0)
+            double PE_avg = 0;
+            double children_PE_avg = 0;
+            int times_total = 0;
+            for (int j = graph->cue_states_begin[cue]; j < graph->cue_states_begin[cue + 1]; j++)
             {
-                PE_avg += ac->transition_extras[trans].PE_avg * ac->transition_extras[trans].times;
-                times += ac->transition_extras[trans].times;
+                int state = graph->cue_states[j];
+                PE_avg += state_PE[state] * state_extras[state].times;
+                children_PE_avg += children_PE[state] * state_extras[state].times;
+                times_total += state_extras[state].times;
             }
+            assert(times_total == ac->cue_extras[cue].times);
+            cue_PE[cue] = PE_avg / ac->cue_extras[cue].times;
+            cue_children_PE[cue] = children_PE_avg / times_total;
         }
-        if (times == 0)
+
+        // reference cues -- the actions that lead to their rewards, in input order
+        decision_PE.assign(graph->num_cues, 0);
+        delivery_PE.assign(graph->num_cues, 0);
+        for (int cue = 0; cue < graph->num_cues; cue++)
         {
-            return bias;
+            double PE_avg = 0, delivery_PE_avg = 0;
+            int total = 0, delivery_total = 0;
+            for (int j = graph->cue_edges_begin[cue]; j < graph->cue_edges_begin[cue + 1]; j++)
+            {
+                int trans = graph->cue_edges[j];
+                // if it's an action in a decision trial
+                if (graph->DecisionCue(trans) == cue)
+                {
+                    PE_avg += trans_extras[trans].PE_avg * trans_extras[trans].times;
+                    total += trans_extras[trans].times;
+                }
+                // the PE for actual reward delivery from the reward state it leads to
+                delivery_PE_avg += rewarded_PE[graph->edges[trans].to] * trans_extras[trans].times;
+                delivery_total += trans_extras[trans].times;
+            }
+            decision_PE[cue] = PE_avg / total;
+            delivery_PE[cue] = delivery_PE_avg / delivery_total;
         }
-        PE_avg /= times;
-        return PE_avg + bias;
+        aggregates_version = ac->stats_version;
     }
 
-    double GetAveragePEForRewardedTransitionsFromChildrenOf(State *state)
+    // bring the aggregates up to date -- they are only rebuilt when the learner's statistics changed
+    void RefreshAggregates()
     {
-        double PE_avg = 0;
-        int times = 0;
-        // for each action to a reward state (e.g. reward-25)
-        for (int k = 0; k < state->out.size(); k++)
+        if (aggregates_version != ac->stats_version)
         {
-            Transition* trans = state->out[k];
-            // add the PE for actual reward delivery from that reward state
-            PE_avg += GetAveragePEForRewardedTransitionsFrom(trans->to) * ac->transition_extras[trans].times;
-            times += ac->transition_extras[trans].times;
+            BuildAggregates();
         }
-        assert(times == ac->state_extras[state].times);
-        if (times == 0)
-        {
-            return 0;
-        }
-        PE_avg /= times;
-        return PE_avg;
     }
 
-    double GetAveragePEForRewardedTransitionsFromChildrenOf(Cue *cue)
+    double GetAverageReferenceTrialRewardFromDecisionTrialAction(int trans)
+    {
+        // the reference trial cue of the reward this action leads to
+        int ref_cue = ac->graph->reward_cue[ac->graph->edges[trans].to];
+        return ac->cue_extras[ref_cue].reward_avg;
+    }
+
+    double GetAveragePE(int state)
+    {
+        RefreshAggregates();
+        return state_PE[state];
+    }
+
+    double GetAverageCuePE(int cue)
+    {
+        RefreshAggregates();
+        return cue_PE[cue];
+    }
+
+    double GetAverageReferenceTrialPEFromDecisionTrialAction(int trans)
+    {
+        // the reference trial cue of the reward this action leads to
+        return GetAverageCuePE(ac->graph->reward_cue[ac->graph->edges[trans].to]);
+    }
+
+    double GetAveragePEForRewardedTransitionsFrom(int state)
+    {
+        RefreshAggregates();
+        return rewarded_PE[state];
+    }
+
+    double GetAveragePEForRewardedTransitionsFromChildrenOfCue(int cue)
     {
-        double PE_avg;
-        int times = 0;
-        for (int j = 0; j < cue->states.size(); j++)
+        RefreshAggregates();
+        return cue_children_PE[cue];
+    }
+
+    // PE of the choice of the better (high) and of the worse (low) option of a decision cue,
+    // averaged over its states
+    void GetHighLowPE(int cue, double &high_PE_avg, double &low_PE_avg)
+    {
+        // #hardcoded FIXME
+        int left_action_idx = 0;
+        int right_action_idx = 1;
+        high_PE_avg = 0;
+        low_PE_avg = 0;
+        for (int j = ac->graph->cue_states_begin[cue]; j < ac->graph->cue_states_begin[cue + 1]; j++)
         {
-            State *state = cue->states[j];
-            PE_avg += GetAveragePEForRewardedTransitionsFromChildrenOf(state) * ac->state_extras[state].times;
-            times += ac->state_extras[state].times;
+            int state = ac->graph->cue_states[j];
+            // #hardcoded FIXME
+            int trans_left = ac->graph->OutBegin(state) + left_action_idx;
+            int trans_right = ac->graph->OutBegin(state) + right_action_idx;
+            int to_left = ac->graph->edges[trans_left].to;
+            int to_right = ac->graph->edges[trans_right].to;
+            int cue_left = ac->graph->reward_cue[to_left];
+            int cue_right = ac->graph->reward_cue[to_right];
+            if (ac->graph->cue_value[cue_left] > ac->graph->cue_value[cue_right])
+            {
+                high_PE_avg += ac->transition_extras[trans_left].PE_avg;
+                low_PE_avg += ac->transition_extras[trans_right].PE_avg;
+            }
+            else
+            {
+                high_PE_avg += ac->transition_extras[trans_right].PE_avg;
+                low_PE_avg += ac->transition_extras[trans_left].PE_avg;
+            }
+            // !!!!!!!!!!!!!!!!!!!!!!!!!
+            /*trans_left = state->in[0]; trans_right = state->in[0];
+            high_PE_avg += ac->transition_extras[trans_left].PE_avg;
+            low_PE_avg += ac->transition_extras[trans_right].PE_avg;*/
         }
-        assert(times == ac->cue_extras[cue].times);
-        PE_avg /= times;
-        return PE_avg;
+        int num_states = ac->graph->cue_states_begin[cue + 1] - ac->graph->cue_states_begin[cue];
+        high_PE_avg /= num_states;
+        low_PE_avg /= num_states;
     }
 
 
 
 public:
-    Morris(RLMethod *rl_method, double dopamine_bias) :
+    Morris(RLMethod *rl_method, double dopamine_bias, ostream &output = cout) :
         ac(rl_method),
-        bias(dopamine_bias)
-    { }
+        bias(dopamine_bias),
+        out(output),
+        aggregates_version(-1)
+    {
+        // the figures walk the task as it was written, chains and all
+        ac->ExpandChains();
+    }
+
+    // the numbers Figure 2c plots, one per reference cue state, and their names
+    void Figure2cValues(vector<string> &names, vector<double> &values)
+    {
+        for (int cue = 0; cue < 4; cue++)
+        {
+            for (int j = ac->graph->cue_states_begin[cue]; j < ac->graph->cue_states_begin[cue + 1]; j++)
+            {
+                int state = ac->graph->cue_states[j];
+                names.push_back("2c " + ac->graph->cue_name[cue] + " " + ac->graph->state_name[state]);
+                values.push_back(GetAveragePE(state));
+            }
+        }
+    }
+
+    // the numbers Figure 4b plots, high and low for each decision cue, and their names
+    void Figure4bValues(vector<string> &names, vector<double> &values)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            int cue = figure_4b_cues[i];
+            double high_PE_avg, low_PE_avg;
+            GetHighLowPE(cue, high_PE_avg, low_PE_avg);
+            names.push_back("4b " + ac->graph->cue_name[cue] + " high");
+            values.push_back(high_PE_avg + bias);
+            names.push_back("4b " + ac->graph->cue_name[cue] + " low");
+            values.push_back(low_PE_avg + bias);
+        }
+    }
+
+    // have Figure 2c or 4b plot value for the number called name (by the names above), rather
+    // than its value under the current statistics
+    void PlotMeasured(const string &name, double value)
+    {
+        measured.push_back(make_pair(name, value));
+    }
 
     void Figure2a()
     {
         vector<string> x;
         vector<string> y;
-        for (int i = 0; i < 4; i++)
+        for (int cue = 0; cue < 4; cue++)
         {
-            Cue *cue = ac->model->cues[i];
-            x.push_back("'" + cue->name + "'");
+            x.push_back("'" + ac->graph->cue_name[cue] + "'");
             ostringstream ss;
-            for (int j = 0; j < cue->states.size(); j++)
+            for (int j = ac->graph->cue_states_begin[cue]; j < ac->graph->cue_states_begin[cue + 1]; j++)
             {
-                State *state = cue->states[j];
+                int state = ac->graph->cue_states[j];
                 double obtained_reward = ac->state_extras[state].reward_avg;
                 ss<<obtained_reward<<", ";
             }
@@ -222,21 +373,20 @@ public:
         int right_action_idx = 1;
         // for each decision trial cue (e.g. 50-50, or 50-75, etc)
         // #hardcoded... FIXME
-        for (int i = 4; i < 14; i++)
+        for (int cue = 4; cue < 14; cue++)
         {
-            Cue *cue = ac->model->cues[i];
             // for each state for that cue (e.g. 75-50 and 50-75)
-            for (int j = 0; j < cue->states.size(); j++)
+            for (int j = ac->graph->cue_states_begin[cue]; j < ac->graph->cue_states_begin[cue + 1]; j++)
             {
-                State *state = cue->states[j];
-                double R_right = GetAverageReferenceTrialRewardFromDecisionTrialAction(state->out[right_action_idx]);
+                int state = ac->graph->cue_states[j];
+                double R_right = GetAverageReferenceTrialRewardFromDecisionTrialAction(ac->graph->OutBegin(state) + right_action_idx);
                 double R_total = 0;
-                for (int k = 0; k < state->out.size(); k++)
+                for (int trans = ac->graph->OutBegin(state); trans < ac->graph->OutEnd(state); trans++)
                 {
-                    R_total += GetAverageReferenceTrialRewardFromDecisionTrialAction(state->out[k]);
+                    R_total += GetAverageReferenceTrialRewardFromDecisionTrialAction(trans);
                 }
                 x.push_back(R_right / R_total);
-                double C_right = ac->transition_extras[state->out[right_action_idx]].measured_probability;
+                double C_right = ac->transition_extras[ac->graph->OutBegin(state) + right_action_idx].measured_probability;
                 y.push_back(C_right);
             }
         }
@@ -248,15 +398,17 @@ public:
     {
         vector<string> x;
         vector<string> y;
-        for (int i = 0; i < 4; i++)
+        vector<string> names;
+        vector<double> values;
+        Figure2cValues(names, values);
+        int k = 0;
+        for (int cue = 0; cue < 4; cue++)
         {
-            Cue *cue = ac->model->cues[i];
-            x.push_back("'" + cue->name + "'");
+            x.push_back("'" + ac->graph->cue_name[cue] + "'");
             ostringstream ss;
-            for (int j = 0; j < cue->states.size(); j++)
+            for (int j = ac->graph->cue_states_begin[cue]; j < ac->graph->cue_states_begin[cue + 1]; j++, k++)
             {
-                State* state = cue->states[j];
-                double dopamine_response = GetAveragePE(state);
+                double dopamine_response = Plotted(names[k], values[k]);
                 ss<<dopamine_response<<", ";
             }
             y.push_back(ss.str());
@@ -272,21 +424,20 @@ public:
         int right_action_idx = 1;
         // for each decision trial cue (e.g. 50-50, or 50-75, etc)
         // #hardcoded... FIXME
-        for (int i = 4; i < 14; i++)
+        for (int cue = 4; cue < 14; cue++)
         {
-            Cue *cue = ac->model->cues[i];
             // for each state for that cue (e.g. 75-50 and 50-75)
-            for (int j = 0; j < cue->states.size(); j++)
+            for (int j = ac->graph->cue_states_begin[cue]; j < ac->graph->cue_states_begin[cue + 1]; j++)
             {
-                State *state = cue->states[j];
-                double D_right = GetAverageReferenceTrialPEFromDecisionTrialAction(state->out[right_action_idx]);
+                int state = ac->graph->cue_states[j];
+                double D_right = GetAverageReferenceTrialPEFromDecisionTrialAction(ac->graph->OutBegin(state) + right_action_idx);
                 double D_total = 0;
-                for (int k = 0; k < state->out.size(); k++)
+                for (int trans = ac->graph->OutBegin(state); trans < ac->graph->OutEnd(state); trans++)
                 {
-                    D_total += GetAverageReferenceTrialPEFromDecisionTrialAction(state->out[k]);
+                    D_total += GetAverageReferenceTrialPEFromDecisionTrialAction(trans);
                 }
                 x.push_back(D_right / D_total);
-                double C_right = ac->transition_extras[state->out[right_action_idx]].measured_probability;
+                double C_right = ac->transition_extras[ac->graph->OutBegin(state) + right_action_idx].measured_probability;
                 y.push_back(C_right);
             }
         }
@@ -298,11 +449,10 @@ public:
         vector<string> x;
         vector<double> y;
         // #hardcoded FIXME
-        for (int i = 4; i < 14; i++)
+        for (int cue = 4; cue < 14; cue++)
         {
-            Cue *cue = ac->model->cues[i];
-            x.push_back("'" + cue->name + "'");
-            y.push_back(GetAveragePE(cue));
+            x.push_back("'" + ac->graph->cue_name[cue] + "'");
+            y.push_back(GetAverageCuePE(cue));
         }
         PrintFigure<string, double>("4a", 3, 2, 1, "bar", x, y, "State (pair)", "PE ~ Dopamine response");
     }
@@ -311,45 +461,15 @@ public:
     {
         vector<string> x;
         vector<string> y;
-        // #hardcoded FIXME
-        int left_action_idx = 0;
-        int right_action_idx = 1;
-        // #hardcoded FIXME
-        int cue_ids[] = {5, 7, 8, 9, 11, 12};
-        // for each decision cue with distinct outcomes
+        vector<string> names;
+        vector<double> values;
+        Figure4bValues(names, values);
         for (int i = 0; i < 6; i++)
         {
-            Cue *cue = ac->model->cues[cue_ids[i]];
-            x.push_back("'" + cue->name + "'");
-            double high_PE_avg = 0;
-            double low_PE_avg = 0;
-            for (int j = 0; j < cue->states.size(); j++)
-            {
-                State *state = cue->states[j];
-                // #hardcoded FIXME
-                Transition *trans_left = state->out[left_action_idx];
-                Transition *trans_right = state->out[right_action_idx];
-                Cue *cue_left = ac->model->cue_from_name[trans_left->to->extra];
-                Cue *cue_right = ac->model->cue_from_name[trans_right->to->extra];
-                if (cue_left->value > cue_right->value)
-                {
-                    high_PE_avg += ac->transition_extras[trans_left].PE_avg;
-                    low_PE_avg += ac->transition_extras[trans_right].PE_avg;
-                }
-                else
-                {
-                    high_PE_avg += ac->transition_extras[trans_right].PE_avg;
-                    low_PE_avg += ac->transition_extras[trans_left].PE_avg;
-                }
-                // !!!!!!!!!!!!!!!!!!!!!!!!!
-                /*trans_left = state->in[0]; trans_right = state->in[0];
-                high_PE_avg += ac->transition_extras[trans_left].PE_avg;
-                low_PE_avg += ac->transition_extras[trans_right].PE_avg;*/
-            }
-            high_PE_avg /= cue->states.size();
-            low_PE_avg /= cue->states.size();
+            int cue = figure_4b_cues[i];
+            x.push_back("'" + ac->graph->cue_name[cue] + "'");
             ostringstream ss;
-            ss<<high_PE_avg + bias<<", "<<low_PE_avg + bias;
+            ss<<Plotted(names[2 * i], values[2 * i])<<", "<<Plotted(names[2 * i + 1], values[2 * i + 1]);
             y.push_back(ss.str());
         }
         PrintFigure<string, string>("4b", 3, 2, 3, "bar", x, y, "State (pair)", "PE ~ Dopamine response", "legend('high', 'low');\n");
@@ -357,42 +477,20 @@ public:
 
     void Figure4c()
     {
-        set<Cue*> ref_cues;
         vector<double> x, y;
         // reference trials
-        for (int i = 0; i < 4; i++)
+        for (int cue = 0; cue < 4; cue++)
         {
-            Cue *cue = ac->model->cues[i];
-            ref_cues.insert(cue);
             x.push_back(ac->cue_extras[cue].reward_avg);
-            y.push_back(GetAveragePE(cue));
+            y.push_back(GetAverageCuePE(cue));
         }
 
         // decision trials
-        for (int i = 0; i < 4; i++)
+        RefreshAggregates();
+        for (int cue = 0; cue < 4; cue++)
         {
-            Cue *cue = ac->model->cues[i];
-            double PE_avg = 0;
-            int total = 0;
-            for (int j = 0; j < ac->model->transitions.size(); j++)
-            {
-                Transition* trans = ac->model->transitions[j];
-                // if it's an action in a decision trial
-                if (ac->model->cue_from_name.find(trans->to->extra) != ac->model->cue_from_name.end() && ref_cues.find(trans->from->cue) == ref_cues.end())
-                {
-                    Cue* ref_cue = ac->model->cue_from_name[trans->to->extra];
-                    // that corresponds to the same reference cue
-                    if (ref_cue == cue)
-                    {
-                        //trans = trans->from->in[0]; // !!!!!!!!!!!!!!!!
-                        PE_avg += ac->transition_extras[trans].PE_avg * ac->transition_extras[trans].times;
-                        total += ac->transition_extras[trans].times;
-                    }
-                }
-            }
-            PE_avg /= total;
-            x.push_back(cue->value);
-            y.push_back(PE_avg + bias);
+            x.push_back(ac->graph->cue_value[cue]);
+            y.push_back(decision_PE[cue] + bias);
         }
 
         PrintFigure<double, double>("4c", 3, 2, 5, "h1 = scatter", x, y, "Action value", "PE ~ Dopamine response", "lsline;\nhold on;\nh2 = scatter(x_4c(5:end), y_4c(5:end), 'fill', 'blue');\nhold off;\nlegend([h1, h2], 'Reference trials', 'Decision trials');\n");
@@ -403,11 +501,10 @@ public:
         vector<string> x;
         vector<double> y;
         // for each decision cue
-        for (int i = 4; i < 14; i++)
+        for (int cue = 4; cue < 14; cue++)
         {
-            Cue* cue = ac->model->cues[i];
-            x.push_back("'" + cue->name + "'");
-            y.push_back(GetAveragePEForRewardedTransitionsFromChildrenOf(cue));
+            x.push_back("'" + ac->graph->cue_name[cue] + "'");
+            y.push_back(GetAveragePEForRewardedTransitionsFromChildrenOfCue(cue));
         }
         PrintFigure<string, double>("4d", 3, 2, 2, "bar", x, y, "State (pair)", "PE ~ Dopamine response");
     }
@@ -420,36 +517,37 @@ public:
         int left_action_idx = 0;
         int right_action_idx = 1;
         // for each decision cue
-        // #hardcoded FIXME
-        int cue_ids[] = {5, 7, 8, 9, 11, 12};
         for (int i = 0; i < 6; i++)
         {
-            Cue *cue = ac->model->cues[cue_ids[i]];
+            int cue = figure_4b_cues[i];
             double high_PE_avg = 0;
             double low_PE_avg = 0;
-            x.push_back("'" + cue->name + "'");
+            x.push_back("'" + ac->graph->cue_name[cue] + "'");
             // for each state
-            for (int j = 0; j < cue->states.size(); j++)
+            for (int j = ac->graph->cue_states_begin[cue]; j < ac->graph->cue_states_begin[cue + 1]; j++)
             {
-                State *state = cue->states[j];
+                int state = ac->graph->cue_states[j];
                 // #hardcoded FIXME
-                Transition *trans_left = state->out[left_action_idx];
-                Transition *trans_right = state->out[right_action_idx];
-                Cue *cue_left = ac->model->cue_from_name[trans_left->to->extra];
-                Cue *cue_right = ac->model->cue_from_name[trans_right->to->extra];
-                if (cue_left->value > cue_right->value)
+                int trans_left = ac->graph->OutBegin(state) + left_action_idx;
+                int trans_right = ac->graph->OutBegin(state) + right_action_idx;
+                int to_left = ac->graph->edges[trans_left].to;
+                int to_right = ac->graph->edges[trans_right].to;
+                int cue_left = ac->graph->reward_cue[to_left];
+                int cue_right = ac->graph->reward_cue[to_right];
+                if (ac->graph->cue_value[cue_left] > ac->graph->cue_value[cue_right])
                 {
-                    high_PE_avg += GetAveragePEForRewardedTransitionsFrom(trans_left->to);
-                    low_PE_avg += GetAveragePEForRewardedTransitionsFrom(trans_right->to);
+                    high_PE_avg += GetAveragePEForRewardedTransitionsFrom(to_left);
+                    low_PE_avg += GetAveragePEForRewardedTransitionsFrom(to_right);
                 }
                 else
                 {
-                    high_PE_avg += GetAveragePEForRewardedTransitionsFrom(trans_right->to); 
-                    low_PE_avg += GetAveragePEForRewardedTransitionsFrom(trans_left->to);
+                    high_PE_avg += GetAveragePEForRewardedTransitionsFrom(to_right); 
+                    low_PE_avg += GetAveragePEForRewardedTransitionsFrom(to_left);
                 }
             }
-            high_PE_avg /= cue->states.size();
-            low_PE_avg /= cue->states.size();
+            int num_states = ac->graph->cue_states_begin[cue + 1] - ac->graph->cue_states_begin[cue];
+            high_PE_avg /= num_states;
+            low_PE_avg /= num_states;
             ostringstream ss;
             ss<<high_PE_avg<<", "<<low_PE_avg;
             y.push_back(ss.str());
@@ -461,42 +559,38 @@ public:
     {
         vector<double> x, y;
         // reference trials
-        for (int i = 0; i < 4; i++)
+        for (int cue = 0; cue < 4; cue++)
         {
-            Cue *cue = ac->model->cues[i];
             x.push_back(ac->cue_extras[cue].reward_avg);
-            y.push_back(GetAveragePEForRewardedTransitionsFromChildrenOf(cue));
+            y.push_back(GetAveragePEForRewardedTransitionsFromChildrenOfCue(cue));
         }
 
         // decision trials
-        for (int i = 0; i < 4; i++)
+        RefreshAggregates();
+        for (int cue = 0; cue < 4; cue++)
         {
-            Cue *cue = ac->model->cues[i];
-            double PE_avg = 0;
-            int total = 0;
-            for (int j = 0; j < ac->model->transitions.size(); j++)
-            {
-                Transition* trans = ac->model->transitions[j];
-                // if it's an action in a decision trial (i.e. leads to a reward state)
-                if (ac->model->cue_from_name.find(trans->to->extra) != ac->model->cue_from_name.end())
-                {
-                    Cue* ref_cue = ac->model->cue_from_name[trans->to->extra];
-                    // that leads corresponds to the same reference cue
-                    if (ref_cue == cue)
-                    {
-                        // add the PE for actual reward delivery from that reward state  
-                        PE_avg += GetAveragePEForRewardedTransitionsFrom(trans->to) * ac->transition_extras[trans].times;
-                        total += ac->transition_extras[trans].times;
-                    }
-                }
-            }
-            PE_avg /= total;
-            x.push_back(cue->value);
-            y.push_back(PE_avg);
+            x.push_back(ac->graph->cue_value[cue]);
+            y.push_back(delivery_PE[cue]);
         }
         PrintFigure<double, double>("4f", 3, 2, 6, "h1 = scatter", x, y, "Action value", "PE ~ Dopamine response", "lsline;\nhold on;\nh2 = scatter(x_4f(5:end), y_4f(5:end), 'fill', 'blue');\nhold off;\nlegend([h1, h2], 'Reference trials', 'Decision trials');\n");
     }
 
+    // everything main prints, in the same order
+    void AllFigures()
+    {
+        Figure2a();
+        Figure2b();
+        Figure2c();
+        Figure2d();
+        out<<"figure;\n";
+        Figure4a();
+        Figure4b();
+        Figure4c();
+        Figure4d();
+        Figure4e();
+        Figure4f();
+    }
+
 };
 
 
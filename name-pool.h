@@ -0,0 +1,256 @@
+#ifndef NAME_POOL_H
+#define NAME_POOL_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cassert>
+#include <stdint.h>
+
+#include "arena.h"
+
+using namespace std;
+
+// 64-bit FNV-1a
+inline uint64_t HashBytes(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+// minimal perfect hash over a fixed set of names (hash and displace)
+//
+// every name hashes to a bucket; each bucket stores either a seed that sends all of its names
+// to distinct free slots, or -- for a bucket of one -- the slot itself. There are as many slots
+// as names, each holding the id of its name, so a lookup is one hash, two array reads and one
+// compare against the name it finds, whatever the set. The names themselves are not kept:
+// Build and Find take the container they live in (anything indexable by id into something
+// comparable with a string_view), so the index can be copied along with it.
+class PerfectHash
+{
+private:
+    vector<int> displacement; // by bucket; a seed (>= 0) or -(slot + 1)
+    vector<int> slot_id;      // by slot
+
+    static uint64_t Mix(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // x scaled to [0, n) -- cheaper than x % n
+    static int Range(uint64_t x, size_t n)
+    {
+        return (int)(((x >> 32) * n) >> 32);
+    }
+
+    static uint64_t Hash(string_view name)
+    {
+        return Mix(HashBytes(name.data(), name.size()));
+    }
+
+    static int Slot(uint64_t hash, int seed, size_t slots)
+    {
+        return Range(Mix(hash + 0x9e3779b97f4a7c15ULL * (seed + 1)), slots);
+    }
+
+public:
+    // index names[0 .. names.size()); returns the id of a name that appears twice
+    // (the index is then empty), or -1
+    template <class Names>
+    int Build(const Names &names)
+    {
+        size_t n = names.size();
+        displacement.assign(n, 0);
+        slot_id.assign(n, -1);
+        if (n == 0)
+        {
+            return -1;
+        }
+        vector<uint64_t> hash(n);
+        vector<int> bucket_begin(n + 1, 0);
+        for (size_t i = 0; i < n; i++)
+        {
+            hash[i] = Hash(names[i]);
+            bucket_begin[Range(hash[i], n) + 1]++;
+        }
+        for (size_t b = 0; b < n; b++)
+        {
+            bucket_begin[b + 1] += bucket_begin[b];
+        }
+        vector<int> members(n);
+        vector<int> next(bucket_begin.begin(), bucket_begin.end() - 1);
+        for (size_t i = 0; i < n; i++)
+        {
+            members[next[Range(hash[i], n)]++] = i;
+        }
+
+        // the largest buckets go first, while there is the most room
+        int max_size = 0;
+        for (size_t b = 0; b < n; b++)
+        {
+            max_size = max(max_size, bucket_begin[b + 1] - bucket_begin[b]);
+        }
+        vector<int> slots(max_size);
+        for (int size = max_size; size >= 2; size--)
+        {
+            for (size_t b = 0; b < n; b++)
+            {
+                int begin = bucket_begin[b];
+                if (bucket_begin[b + 1] - begin != size)
+                {
+                    continue;
+                }
+                // equal names always share a bucket, so this is where they show up
+                for (int i = 0; i < size; i++)
+                {
+                    for (int j = 0; j < i; j++)
+                    {
+                        int a = members[begin + i], c = members[begin + j];
+                        if (hash[a] == hash[c] && string_view(names[a]) == string_view(names[c]))
+                        {
+                            displacement.clear();
+                            slot_id.clear();
+                            return max(a, c);
+                        }
+                    }
+                }
+                for (int seed = 0; ; seed++)
+                {
+                    assert(seed < (1 << 24)); // only 64-bit hash collisions get here
+                    bool fits = true;
+                    for (int i = 0; i < size && fits; i++)
+                    {
+                        slots[i] = Slot(hash[members[begin + i]], seed, n);
+                        fits = slot_id[slots[i]] == -1;
+                        for (int j = 0; j < i && fits; j++)
+                        {
+                            fits = slots[j] != slots[i];
+                        }
+                    }
+                    if (fits)
+                    {
+                        for (int i = 0; i < size; i++)
+                        {
+                            slot_id[slots[i]] = members[begin + i];
+                        }
+                        displacement[b] = seed;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // buckets of one take whatever slots are left, directly
+        size_t free_slot = 0;
+        for (size_t b = 0; b < n; b++)
+        {
+            if (bucket_begin[b + 1] - bucket_begin[b] != 1)
+            {
+                continue;
+            }
+            while (slot_id[free_slot] != -1)
+            {
+                free_slot++;
+            }
+            slot_id[free_slot] = members[bucket_begin[b]];
+            displacement[b] = -(int)free_slot - 1;
+        }
+        return -1;
+    }
+
+    // the id of name in the names the index was built over, or -1
+    template <class Names>
+    int Find(string_view name, const Names &names) const
+    {
+        size_t n = slot_id.size();
+        if (n == 0)
+        {
+            return -1;
+        }
+        uint64_t hash = Hash(name);
+        int d = displacement[Range(hash, n)];
+        int id = slot_id[d < 0 ? -d - 1 : Slot(hash, d, n)];
+        return string_view(names[id]) == name ? id : -1;
+    }
+
+    size_t BytesUsed() const
+    {
+        return (displacement.size() + slot_id.size()) * sizeof(int);
+    }
+};
+
+
+// names interned into one pool, numbered in order of addition
+//
+// Add copies a name in and gives it the next id; once a set of names is complete, Build
+// indexes it with a PerfectHash and Find works. Names never move, so the views Name hands
+// out live as long as the pool.
+class NamePool
+{
+private:
+    NamePool(const NamePool&);
+    NamePool& operator=(const NamePool&);
+
+    Arena chars;
+    vector<string_view> names;
+    PerfectHash index;
+    bool indexed;
+
+public:
+    NamePool() :
+        indexed(true)
+    { }
+
+    int Add(string_view name)
+    {
+        names.push_back(chars.Copy(name));
+        indexed = false;
+        return names.size() - 1;
+    }
+
+    // index the names added so far; returns the id of a name added twice, or -1
+    // (nothing to do if nothing was added since the last Build)
+    int Build()
+    {
+        if (indexed)
+        {
+            return -1;
+        }
+        int duplicate = index.Build(names);
+        indexed = duplicate == -1;
+        return duplicate;
+    }
+
+    // the id of name, or -1 if there is none; only names added before the last Build are found
+    int Find(string_view name) const
+    {
+        return index.Find(name, names);
+    }
+
+    string_view Name(int id) const
+    {
+        return names[id];
+    }
+
+    int Size() const
+    {
+        return names.size();
+    }
+
+    void Reserve(int count)
+    {
+        names.reserve(count);
+    }
+};
+
+#endif
@@ -3,99 +3,179 @@
 
 #include "sarsa.h"
 
-class QLearning : public SARSA 
+// Q-learning specialised at compile time on its Selection policy --
+// Softmax, ProbabilityMatching or EpsGreedy (action-selection.h)
+// it shares the tables and policy inputs of SARSA, only the update differs
+template <class SelectionPolicy>
+class QLearning : public SARSABase
 {
 public:
+    typedef SelectionPolicy Selection;
 
     QLearning(ExperimentalModel *experiment_model,
         double critic_learning_rate,
         double actor_learning_rate,
         double discount_factor,
-        ActionSelectionMethod action_selection_method,
         double softmax_temperature,
         double minimum_action_reward,
         double fraction_wrong_button,
         double epsilon_greedy_constant) :
-        SARSA(experiment_model,
+        SARSABase(experiment_model,
         critic_learning_rate,
         actor_learning_rate,
         discount_factor,
-        action_selection_method,
+        Selection::method,
         softmax_temperature,
         minimum_action_reward,
         fraction_wrong_button,
         epsilon_greedy_constant)
     { }
 
-    void Trial(bool do_print)
+    // Q-learning updates towards the best choice, not the one it goes on to take
+    double ContinuationValue(int state)
     {
-        if (do_print) cout<<"\n  ---------------------- TRIAL --------------\n\n";
-        State *S = model->start;
-        Transition *A = PickTransition(S);
+        if (graph->type[state] == DETERMINISTIC && !graph->terminal[state])
+        {
+            int opt = GetOptimalChoice(state);
+            return opt != -1 ? Q[opt] : 0;
+        }
+        return SARSABase::ContinuationValue(state);
+    }
+
+    // one trial; the trace is compiled out unless traced
+    template <bool traced>
+    void RunTrial(ostream &out)
+    {
+        if (traced) out<<"\n  ---------------------- TRIAL --------------\n\n";
+        int S = StartState();
+        int A = PickTransition<QLearning>(S);
 
         double PE_prev = 0;
-        map<Cue*, double> seen_cues;
-        map<State*, double> seen_cue_states;
-        while (S != model->end)
+        BeginTrial();
+        while (!graph->terminal[S])
         {
-            State *S_new = A->to;
-            Transition *A_new = PickTransition(S_new);
+            int S_new = graph->edges[A].to;
+            int A_new = PickTransition<QLearning>(S_new);
+            if (graph->terminal[S_new])
+            {
+                A_new = -1; // the trial is over, whatever edges lead on
+            }
 
-            double R_new = S_new->reward;
-            Transition *a_optimal = A_new;
-            if (S_new->type == DETERMINISTIC)
+            double R_new = graph->edges[A].reward;
+            int a_optimal = A_new;
+            if (graph->type[S_new] == DETERMINISTIC && A_new != -1)
             {
                 a_optimal = GetOptimalChoice(S_new);
             }
-            double PE = R_new + gamma * Q[a_optimal] - Q[A];
+            double Q_optimal = a_optimal != -1 ? Q[a_optimal] : 0; // no action out of a terminal state
+            double PE = R_new + discount[A] * Q_optimal - Q[A];
+            if (graph->type[S] == DETERMINISTIC)
+            {
+                InvalidatePolicy<QLearning>(S);
+            }
             Q[A] += eta * PE;
 
             // update policy
-            if (S->type == DETERMINISTIC)
+            if (graph->type[S] == DETERMINISTIC)
             {
-                H[dynamic_cast<Choice*>(A)] += alpha * PE;
+                H[A] += alpha * PE;
             }
             UpdatePolicy(S);
-            if (do_print) cout<<" from "<<S->name<<" to "<<S_new->name<<", PE = "<<PE<<"\n";
+            if (traced) out<<" from "<<graph->state_name[S]<<" to "<<graph->state_name[S_new]<<", PE = "<<PE<<"\n";
 
             // bookkeeping -- average PE per action & prob of chosing this action
             UpdateAveragePE(A, PE + PE_prev);
 
-            // bookkeeping -- average reward received per seen cue
-            if (S->cue != NULL && seen_cues.find(S->cue) == seen_cues.end())
-            {
-                seen_cues[S->cue] = 0;
-            }
-            for (map<Cue*, double>::iterator it = seen_cues.begin(); it != seen_cues.end(); it++)
-            {
-                it->second += S->reward;
-            }
-
-            // bookkeeping -- average reward received per seen cue state (similar to above)
-            if (S->cue != NULL && seen_cue_states.find(S) == seen_cue_states.end())
-            {
-                seen_cue_states[S] = 0;
-            }
-            for (map<State*, double>::iterator it = seen_cue_states.begin(); it != seen_cue_states.end(); it++)
-            {
-                it->second += S->reward;
-            }
+            // bookkeeping -- average reward received per seen cue (and cue state)
+            SeeState(S, A);
           
             // move to new state
             PE_prev = PE;
             S = S_new;
             A = A_new;
         }
-        // bookkeeping -- update the average reward for all cues passed on this trial
-        for (map<Cue*, double>::iterator it = seen_cues.begin(); it != seen_cues.end(); it++)
+        EndTrial();
+    }
+
+    void Trial(bool do_print)
+    {
+        if (do_print)
+        {
+            RunTrial<true>(cout);
+        }
+        else
         {
-            UpdateAverageReward(it->first, it->second);
+            RunTrial<false>(cout);
         }
-        // bookkeeping -- same for cue states
-        for (map<State*, double>::iterator it = seen_cue_states.begin(); it != seen_cue_states.end(); it++)
+    }
+
+    // the PE of every step is R + gamma ContinuationValue(next) - Q, and each transition is
+    // credited with its own plus, on average, that of the step before (none out of a start) --
+    // which out of a chance state looked ahead to Q of the very transition that was drawn
+    void ExpectStatistics(int trials)
+    {
+        ExpectedVisits<QLearning>();
+        int T = graph->num_transitions;
+        vector<double> reward_less_Q(T), base, discounted, credit(T, 0), credited_PE(T, 0);
+        continuation.resize(graph->num_states);
+        for (int state = 0; state < graph->num_states; state++)
         {
-            UpdateAverageReward(it->first, it->second);
+            continuation[state] = ContinuationValue(state);
         }
+        for (int e = 0; e < T; e++)
+        {
+            reward_less_Q[e] = graph->edges[e].reward - Q[e];
+        }
+        Inflow(reward_less_Q, base);
+        Inflow(discount, discounted);
+        for (int S = 0; S < graph->num_states; S++)
+        {
+            if (graph->terminal[S] || occupancy[S] == 0)
+            {
+                continue;
+            }
+            for (int a = graph->OutBegin(S); a < graph->OutEnd(S); a++)
+            {
+                const Edge &edge = graph->edges[a];
+                double next = graph->type[S] == PROBABILISTIC ? Q[a] : continuation[S];
+                double PE_prev_avg = (base[S] + discounted[S] * next) / occupancy[S];
+                credit[a] = occupancy[S] * take_probability[a];
+                credited_PE[a] = edge.reward + discount[a] * continuation[edge.to] - Q[a] + PE_prev_avg;
+            }
+        }
+        FillExpectedStatistics(trials, credit, credited_PE);
+        MarkPoliciesStale();
+    }
+
+    void RunExpectedBatch(int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            ExpectedTrial<QLearning>(true);
+        }
+    }
+
+    void RunBatch(int count, ostream *trace)
+    {
+        if (trace == NULL)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                RunTrial<false>(cout);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < count; i++)
+            {
+                RunTrial<true>(*trace);
+            }
+        }
+    }
+
+    void RefreshPolicies()
+    {
+        RefreshAllPolicies<QLearning>();
     }
 
 };
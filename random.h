@@ -0,0 +1,101 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+// the i-th number of a stream is a pure function of (seed, stream, i), so every
+// learner can own its stream and get the same numbers no matter what else runs alongside
+class Philox
+{
+private:
+    uint32_t key[2];      // the seed
+    uint32_t stream[2];   // upper half of the counter -- e.g. the agent id
+    uint64_t position;    // index of the next 32-bit number in the stream
+    uint64_t cached_block;
+    uint32_t block[4];
+
+    static void MulHiLo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+    {
+        uint64_t product = (uint64_t)a * b;
+        hi = (uint32_t)(product >> 32);
+        lo = (uint32_t)product;
+    }
+
+    void Generate(uint64_t index)
+    {
+        uint32_t ctr[4] = { (uint32_t)index, (uint32_t)(index >> 32), stream[0], stream[1] };
+        uint32_t k[2] = { key[0], key[1] };
+        for (int round = 0; round < 10; round++)
+        {
+            uint32_t hi0, lo0, hi1, lo1;
+            MulHiLo(0xD2511F53, ctr[0], hi0, lo0);
+            MulHiLo(0xCD9E8D57, ctr[2], hi1, lo1);
+            uint32_t next[4] = { hi1 ^ ctr[1] ^ k[0], lo1, hi0 ^ ctr[3] ^ k[1], lo0 };
+            ctr[0] = next[0];
+            ctr[1] = next[1];
+            ctr[2] = next[2];
+            ctr[3] = next[3];
+            k[0] += 0x9E3779B9;
+            k[1] += 0xBB67AE85;
+        }
+        block[0] = ctr[0];
+        block[1] = ctr[1];
+        block[2] = ctr[2];
+        block[3] = ctr[3];
+        cached_block = index;
+    }
+
+public:
+    Philox(uint64_t seed = 0, uint64_t stream_id = 0)
+    {
+        Seed(seed, stream_id);
+    }
+
+    void Seed(uint64_t seed, uint64_t stream_id)
+    {
+        key[0] = (uint32_t)seed;
+        key[1] = (uint32_t)(seed >> 32);
+        stream[0] = (uint32_t)stream_id;
+        stream[1] = (uint32_t)(stream_id >> 32);
+        position = 0;
+        Generate(0);
+    }
+
+    // skip the next n numbers in O(1)
+    void Jump(uint64_t n)
+    {
+        position += n;
+    }
+
+    uint64_t Position() const
+    {
+        return position;
+    }
+
+    uint32_t Next()
+    {
+        uint64_t index = position >> 2;
+        if (index != cached_block)
+        {
+            Generate(index);
+        }
+        return block[position++ & 3];
+    }
+
+    // uniform in [0, 1), 53 bits
+    double NextDouble()
+    {
+        uint64_t hi = Next() >> 5;
+        uint64_t lo = Next() >> 6;
+        return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+    }
+
+    // uniform in 0..n-1
+    int NextInt(int n)
+    {
+        return (int)(((uint64_t)Next() * (uint32_t)n) >> 32);
+    }
+};
+
+#endif
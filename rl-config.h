@@ -0,0 +1,146 @@
+#ifndef RL_CONFIG_H
+#define RL_CONFIG_H
+
+#include <sstream>
+
+#include "actor-critic.h"
+#include "sarsa.h"
+#include "q-learning.h"
+
+enum LearnerType
+{
+    LEARNER_ACTOR_CRITIC,
+    LEARNER_SARSA,
+    LEARNER_Q_LEARNING
+};
+
+// everything needed to construct and run one learner
+struct RLConfig
+{
+    LearnerType learner;
+    double eta; // critic learning rate
+    double alpha; // actor learning rate
+    double gamma; // discount factor
+    ActionSelectionMethod method; // action selection method
+    DAInterpretation interpretation; // which PE the bookkeeping credits (actor-critic only)
+    double beta; // softmax temperature
+    double min_R; // minimum action reward for probability matching
+    double noise; // fraction of wrong button presses
+    double eps; // epsilon for epsilon-greedy action selection
+    uint64_t seed;
+    uint64_t agent_id;
+    int trials;
+    bool compress_chains; // run on model->Chains(gamma) -- build it with model->CompressChains(gamma) first
+    bool mean_field; // run the expected (mean-field) dynamics instead of sampled trials -- RLMethod::UseMeanField
+    bool exact_statistics; // after the trials, replace the bookkeeping with its exact expectation -- RLMethod::ExpectStatistics
+    Convergence convergence; // stop before trials once the tables settled -- off unless convergence.window > 0
+    vector<pair<string, double> > measure; // after learning, measure figure ("2c", "4b") to that standard error (measurement.h)
+    int measure_max_trials; // at most that many trials of measurement
+
+    RLConfig() :
+        learner(LEARNER_ACTOR_CRITIC),
+        eta(0.01),
+        alpha(0.005),
+        gamma(1),
+        method(SOFTMAX),
+        interpretation(STANDARD_DA),
+        beta(0.01),
+        min_R(0.1),
+        noise(0),
+        eps(0.01),
+        seed(0),
+        agent_id(0),
+        trials(300000),
+        compress_chains(false),
+        mean_field(false),
+        exact_statistics(false),
+        measure_max_trials(1000000)
+    { }
+
+    string ToString() const
+    {
+        const char *learner_names[] = {"ActorCritic", "SARSA", "QLearning"};
+        const char *method_names[] = {"SOFTMAX", "PROBABILITY_MATCHING", "EPS_GREEDY"};
+        const char *interpretation_names[] = {"STANDARD_DA", "EXTENDED_DA"};
+        ostringstream ss;
+        ss<<learner_names[learner]<<" "<<method_names[method]<<" "<<interpretation_names[interpretation]<<" eta = "<<eta<<", alpha = "<<alpha<<", gamma = "<<gamma<<", beta = "<<beta<<", min_R = "<<min_R<<", noise = "<<noise<<", eps = "<<eps<<", seed = "<<seed<<", agent = "<<agent_id<<", trials = "<<trials<<(compress_chains ? ", compressed chains" : "")<<(mean_field ? ", mean-field" : "")<<(exact_statistics ? ", exact statistics" : "");
+        if (convergence.window > 0)
+        {
+            ss<<", converge window = "<<convergence.window<<", tolerance = "<<convergence.tolerance<<", relative tolerance = "<<convergence.relative_tolerance<<", patience = "<<convergence.patience;
+        }
+        for (int i = 0; i < measure.size(); i++)
+        {
+            ss<<(i == 0 ? ", measure " : " and ")<<measure[i].first<<" to "<<measure[i].second;
+        }
+        if (!measure.empty())
+        {
+            ss<<" within "<<measure_max_trials<<" trials";
+        }
+        return ss.str();
+    }
+};
+
+
+// the instantiation of config.learner for a given action selection policy
+template <class Selection>
+RLMethod* CreateRLMethodWith(ExperimentalModel *model, const RLConfig &config)
+{
+    switch (config.learner)
+    {
+        case LEARNER_ACTOR_CRITIC:
+        {
+            if (config.interpretation == EXTENDED_DA)
+            {
+                return new ActorCritic<Selection, ExtendedDA>(model, config.eta, config.alpha, config.gamma, config.beta, config.min_R, config.noise, config.eps);
+            }
+            return new ActorCritic<Selection, StandardDA>(model, config.eta, config.alpha, config.gamma, config.beta, config.min_R, config.noise, config.eps);
+        }
+        case LEARNER_SARSA:
+        {
+            return new SARSA<Selection>(model, config.eta, config.alpha, config.gamma, config.beta, config.min_R, config.noise, config.eps);
+        }
+        case LEARNER_Q_LEARNING:
+        {
+            return new QLearning<Selection>(model, config.eta, config.alpha, config.gamma, config.beta, config.min_R, config.noise, config.eps);
+        }
+    }
+    return NULL;
+}
+
+
+// construct (and seed) the learner described by config
+// this is the one place the runtime choices are turned into template arguments
+inline RLMethod* CreateRLMethod(ExperimentalModel *model, const RLConfig &config)
+{
+    RLMethod *rl_method = NULL;
+    switch (config.method)
+    {
+        case SOFTMAX:
+        {
+            rl_method = CreateRLMethodWith<Softmax>(model, config);
+            break;
+        }
+        case PROBABILITY_MATCHING:
+        {
+            rl_method = CreateRLMethodWith<ProbabilityMatching>(model, config);
+            break;
+        }
+        case EPS_GREEDY:
+        {
+            rl_method = CreateRLMethodWith<EpsGreedy>(model, config);
+            break;
+        }
+    }
+    assert(rl_method != NULL);
+    if (config.compress_chains)
+    {
+        const CompiledModel *chains = model->Chains(config.gamma);
+        assert(chains != NULL);
+        rl_method->UseGraph(chains);
+    }
+    rl_method->UseMeanField(config.mean_field);
+    rl_method->Seed(config.seed, config.agent_id);
+    return rl_method;
+}
+
+#endif
@@ -13,18 +13,54 @@
 #include <cassert>
 
 #include "model.h"
+#include "random.h"
+#include "action-selection.h"
 
-enum ActionSelectionMethod
+// when RunTrials may stop before all of its trials ran
+// the value table (V or Q), the preferences H and the policy are looked at looks times per window of trials,
+// and each window's average is compared with the last one's -- sampled tables jitter by about
+// sqrt(eta) of the rewards from trial to trial, which the averages smooth out. A table has
+// settled when its largest change is at most tolerance, or at most relative_tolerance times its
+// largest entry; once all three settled patience windows in a row, the run stops.
+struct Convergence
 {
-    SOFTMAX,
-    PROBABILITY_MATCHING,
-    EPS_GREEDY
+    int window; // in trials (rounded down to a multiple of looks); 0 for never stopping early
+    int looks;  // per window, evenly spaced
+    double tolerance;
+    double relative_tolerance;
+    int patience;
+
+    Convergence() :
+        window(0),
+        looks(10),
+        tolerance(1e-3),
+        relative_tolerance(1e-3),
+        patience(3)
+    { }
+};
+
+
+// options for RLMethod::RunTrials -- by default it just runs the trials, silently
+struct RunOptions
+{
+    int progress_every; // call progress after every that many trials; 0 for never
+    function<void(int trials_done, int trials_total)> progress;
+    int trace_last; // trace the steps of the last that many trials
+    ostream *trace; // where the trace goes; NULL for nowhere
+    Convergence convergence; // stop early once the tables settled; off by default
+
+    RunOptions() :
+        progress_every(0),
+        trace_last(0),
+        trace(NULL)
+    { }
 };
 
+
 class RLMethod
 {
 protected:
-    ExperimentalModel *model;
+    const CompiledModel *graph;
     double eta; // critic learning rate
     double alpha; // actor learning rate
     double gamma; // discount factor 
@@ -34,9 +70,20 @@ protected:
     double noise; // in what fraction of the cases will the monkey accidentally press the wrong button)
     double eps; // epsilon for epsilon-greedy action selection
 
-    map<Choice*, double> policy;
-    map<Choice*, double> H;
-    map<State*, Choice*> optimal;
+    Philox rng; // every draw of this learner comes from its own stream
+
+    // tables are flat arrays indexed by the ids in the compiled graph
+    // hot -- read and written on every step of a trial
+    vector<double> discount; // by transition id; gamma, or gamma^k on a macro-edge standing for k edges
+    vector<double> chain_reward; // by transition id; reward of the chain states a macro-edge skips
+    vector<double> policy; // by transition id
+    vector<double> H; // by transition id
+    vector<int> optimal; // by state id; transition id, or -1 for none
+    vector<double> policy_cdf; // by transition id; running sum of policy over the state's choices
+    vector<char> policy_stale; // by state id; an input of the policy changed since it was computed
+    vector<char> policy_pending; // by state id; visited while stale -- recompute before it is used
+
+    // cold -- bookkeeping for the figures
 
     struct StateExtra
     {
@@ -45,7 +92,7 @@ protected:
         int reward_times; // how many times we passed that state; for cue states only; used for calculating reward_avg
         StateExtra() : times(0), reward_avg(0), reward_times(0) { }
     };
-    map<State*, StateExtra> state_extras;
+    vector<StateExtra> state_extras; // by state id
 
     struct TransitionExtra
     {
@@ -54,7 +101,7 @@ protected:
         double measured_probability;   // what is the real probability, measured in practice, of this transition happening vs. any of the other transitions from that origin state
         TransitionExtra() : PE_avg(0), times(0), measured_probability(0) { }
     };
-    map<Transition*, TransitionExtra> transition_extras;
+    vector<TransitionExtra> transition_extras; // by transition id
 
     struct CueExtra
     {
@@ -63,139 +110,572 @@ protected:
         double PE_avg;     // average PE for transitions going straight out of this cue
         CueExtra() : reward_avg(0), times(0), PE_avg(0) { }
     };
-    map<Cue*, CueExtra> cue_extras;
+    vector<CueExtra> cue_extras; // by cue id
+
+    int trials_run; // trials since the last Reset (or that ExpectStatistics stood for)
+    int converged_at; // trials the last RunTrials had run when the tables converged, or -1
+    long long stats_version; // bumped whenever the statistics above change, so whatever is computed from them knows when to redo it
+
+    // mean-field mode -- instead of sampling trials, every table moves by the update a trial
+    // makes on average under the current policy, all at once (see ExpectedVisits)
+    bool mean_field;
+    vector<double> occupancy;        // by state id; expected number of visits in one trial
+    vector<double> take_probability; // by transition id; chance it is taken once its origin is reached
+
+    // convergence (see Convergence) -- the sum of the looks at each table in this window,
+    // and their average over the last one
+    vector<double> values_sum, H_sum, policy_sum;
+    vector<double> values_before, H_before, policy_before;
+    int window_looks;
+    int settled_windows; // in a row, up to now
+
+    static void Accumulate(const vector<double> &table, vector<double> &sum)
+    {
+        sum.resize(table.size(), 0);
+        for (int i = 0; i < table.size(); i++)
+        {
+            sum[i] += table[i];
+        }
+    }
+
+    // whether the average of the window (sum / looks) moved by at most what criterion allows
+    // from before; before becomes that average and sum starts over
+    static bool Settled(vector<double> &sum, int looks, vector<double> &before, const Convergence &criterion)
+    {
+        double change = before.size() == sum.size() ? 0 : HUGE_VAL;
+        double largest = 0;
+        for (int i = 0; i < sum.size(); i++)
+        {
+            double average = sum[i] / looks;
+            if (i < before.size())
+            {
+                change = max(change, fabs(average - before[i]));
+            }
+            largest = max(largest, fabs(average));
+            sum[i] = average;
+        }
+        before.swap(sum);
+        sum.assign(before.size(), 0);
+        return change <= max(criterion.tolerance, criterion.relative_tolerance * largest);
+    }
+
+    void StartConvergence()
+    {
+        values_sum.clear();
+        H_sum.clear();
+        policy_sum.clear();
+        values_before.clear();
+        H_before.clear();
+        policy_before.clear();
+        window_looks = 0;
+        settled_windows = 0;
+    }
+
+    void LookAtTables()
+    {
+        RefreshPolicies();
+        Accumulate(Values(), values_sum);
+        Accumulate(H, H_sum);
+        Accumulate(policy, policy_sum);
+        window_looks++;
+    }
+
+    // at the end of a window; true once the tables converged
+    bool Converged(const Convergence &criterion)
+    {
+        // all of them are compared, so that all the averages move on; H only counts where
+        // the policy is made from it (the actor-critic's softmax) -- elsewhere it may drift freely
+        bool settled = Settled(values_sum, window_looks, values_before, criterion);
+        settled = (Settled(H_sum, window_looks, H_before, criterion) || method != SOFTMAX) && settled;
+        settled = Settled(policy_sum, window_looks, policy_before, criterion) && settled;
+        window_looks = 0;
+        settled_windows = settled ? settled_windows + 1 : 0;
+        return settled_windows >= criterion.patience;
+    }
+
+    // per-trial scratch for the reward bookkeeping -- sized in Reset, so a trial allocates nothing
+    // every cue (and cue state) remembers the running reward at the moment it was first seen,
+    // so what it collected by the end of the trial is one subtraction
+    double trial_reward; // rewards collected so far this trial
+    vector<int> seen_cues; // cue ids seen this trial
+    vector<char> cue_seen; // by cue id
+    vector<double> cue_seen_at; // by cue id
+    vector<int> seen_cue_states; // cue state ids seen this trial
+    vector<char> state_seen; // by state id
+    vector<double> state_seen_at; // by state id
+
+    // the policy methods below are templated on the concrete learner, so the calls
+    // into it (GetOptimalChoice, ChoicePreference, ChoiceValue and the weights of
+    // its Selection policy) are resolved at compile time
 
-    Transition* PickTransition(State *state)
+    // where the next trial starts -- this only draws if there is more than one start state
+    int StartState()
     {
-        double r = (double)rand() / RAND_MAX;
+        const vector<int> &starts = graph->start_states;
+        assert(!starts.empty());
+        return starts.size() == 1 ? starts[0] : starts[rng.NextInt(starts.size())];
+    }
+
+    // returns the id of the picked transition, or -1 if there is none
+    template <class Learner>
+    int PickTransition(int state)
+    {
+        double r = rng.NextDouble();
+        if (graph->type[state] == PROBABILISTIC)
+        {
+            return graph->SampleChance(state, r);
+        }
+
+        if (policy_pending[state])
+        {
+            RefreshPolicy<Learner>(state);
+        }
+        // the last choice also takes whatever rounding left its running sum short of r
+        int begin = graph->OutBegin(state), end = graph->OutEnd(state);
+        int result = begin < end ? end - 1 : -1;
+        for (int e = begin; e < end - 1; e++)
+        {
+            if (policy_cdf[e] >= r)
+            {
+                result = e;
+                break;
+            }
+        }
+
+        // noise -- press wrong button sometimes
+        r = rng.NextDouble();
+        if (r < noise)
+        {
+            int trans_idx = rng.NextInt(graph->OutDegree(state));
+            result = graph->OutBegin(state) + trans_idx;
+        }
+        return result;
+    }
+
+    // policies are computed lazily:
+    // a state's policy is the one it would have gotten from UpdatePolicy on its last visit,
+    // but it is only recomputed if one of its inputs changed since (stale), and only
+    // right before it is needed -- when the state is sampled again, or right before
+    // one of its inputs changes again (which would make the visit-time policy unrecoverable)
+    template <class Learner>
+    void RefreshPolicy(int state)
+    {
+        Learner *learner = static_cast<Learner*>(this);
+        double total = 0;
+        int num_choices = graph->OutDegree(state);
+        optimal[state] = learner->GetOptimalChoice(state);
+        for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+        {
+            double weight = Learner::Selection::Weight(learner->ChoicePreference(e), learner->ChoiceValue(e), e == optimal[state], num_choices, beta, min_R, eps);
+            policy[e] = weight;
+            total += weight;
+        }
         double tot = 0;
-        Transition* result = NULL;
-        for (int i = 0; i < state->out.size(); i++)
+        for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+        {
+            policy[e] /= total;
+            tot += policy[e];
+            policy_cdf[e] = tot;
+        }
+        policy_stale[state] = 0;
+        policy_pending[state] = 0;
+    }
+
+    // must be called right BEFORE something the policy of state depends on changes
+    // (H or Q of its choices, V of the states they lead to)
+    template <class Learner>
+    void InvalidatePolicy(int state)
+    {
+        if (policy_pending[state])
+        {
+            RefreshPolicy<Learner>(state);
+        }
+        policy_stale[state] = 1;
+    }
+
+    void UpdatePolicy(int state)
+    {
+        if (graph->type[state] == PROBABILISTIC)
+        {
+            // no policy for non-choice transitions (i.e. non-deterministic states)
+            return;
+        }
+        if (policy_stale[state])
+        {
+            policy_pending[state] = 1;
+        }
+    }
+
+    // bring every policy up to date -- what the learners' RefreshPolicies() do
+    template <class Learner>
+    void RefreshAllPolicies()
+    {
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            if (policy_pending[state])
+            {
+                RefreshPolicy<Learner>(state);
+            }
+        }
+    }
+
+    // rebuild the cumulative policies from policy and mark all of them stale,
+    // i.e. as if every state had just been visited with its current policy
+    void ResetPolicyCache()
+    {
+        policy_cdf.assign(graph->num_transitions, 0);
+        policy_stale.assign(graph->num_states, 0);
+        policy_pending.assign(graph->num_states, 0);
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            if (graph->type[state] == DETERMINISTIC)
+            {
+                double tot = 0;
+                for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+                {
+                    tot += policy[e];
+                    policy_cdf[e] = tot;
+                }
+                policy_stale[state] = 1;
+            }
+        }
+    }
+
+    // mean-field -- recompute every policy from the tables as they are now (as if every state
+    // were visited this moment), then fill take_probability (noise included) and occupancy.
+    // On a graph whose edges all go forward in id order (any compiled DAG) one sweep over the
+    // states in id order is exact; otherwise the sweeps repeat until occupancy settles
+    // (or a cap is hit -- on a graph a trial may never leave it does not).
+    template <class Learner>
+    void ExpectedVisits()
+    {
+        int N = graph->num_states;
+        bool forward = true;
+        for (int state = 0; state < N; state++)
         {
-            Transition *trans = state->out[i];
-            if (state->type == PROBABILISTIC)
+            int k = graph->OutDegree(state);
+            if (graph->type[state] == DETERMINISTIC)
             {
-                Chance *chance = dynamic_cast<Chance*>(trans);
-                tot += chance->probability;
+                RefreshPolicy<Learner>(state);
+                for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+                {
+                    take_probability[e] = (1 - noise) * policy[e] + noise / k;
+                }
             }
             else
             {
-                Choice *choice = dynamic_cast<Choice*>(trans);
-                tot += policy[choice];
+                double total = 0;
+                for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+                {
+                    total += graph->edges[e].Probability();
+                }
+                for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+                {
+                    take_probability[e] = graph->edges[e].Probability() / total;
+                }
             }
-            if (tot >= r)
+            for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
             {
-                result = trans;
-                break;
+                forward = forward && graph->edges[e].to > state;
             }
         }
 
-        // noise -- press wrong button sometimes
-        if (state->type == DETERMINISTIC)
+        vector<double> start_visits(N, 0);
+        for (int i = 0; i < graph->start_states.size(); i++)
+        {
+            start_visits[graph->start_states[i]] += 1.0 / graph->start_states.size();
+        }
+        // (the sweeps start from the occupancy of the last trial, which the policy barely moved)
+        for (int sweep = 0; sweep < 100000; sweep++)
         {
-            double r = (double)rand() / RAND_MAX;
-            if (r < noise)
+            double change = 0, largest = 1;
+            for (int state = 0; state < N; state++)
             {
-                int trans_idx = rand() % state->out.size();
-                result = state->out[trans_idx];
+                double visits = start_visits[state];
+                for (int i = graph->in_begin[state]; i < graph->in_begin[state + 1]; i++)
+                {
+                    int e = graph->in_edges[i];
+                    int from = graph->edge_from[e];
+                    if (!graph->terminal[from])
+                    {
+                        visits += occupancy[from] * take_probability[e];
+                    }
+                }
+                change = max(change, fabs(visits - occupancy[state]));
+                largest = max(largest, visits);
+                occupancy[state] = visits;
+            }
+            if (forward || change < 1e-12 * largest)
+            {
+                break;
             }
         }
-        return result;
     }
 
-    virtual Choice* GetOptimalChoice(State *state) = 0;
+    // after ExpectedVisits -- treat every policy it computed as seen on a visit, so the
+    // tables can change under it
+    void MarkPoliciesStale()
+    {
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            if (graph->type[state] == DETERMINISTIC)
+            {
+                policy_stale[state] = 1;
+            }
+        }
+    }
 
-    virtual double GetChoiceWeight(Choice *choice) = 0;
+    // exact statistics -- sum[s] = value[e] weighted by how often e is taken per trial, over the
+    // edges e into s (out of states a trial goes on from); needs ExpectedVisits first
+    void Inflow(const vector<double> &value, vector<double> &sum)
+    {
+        sum.assign(graph->num_states, 0);
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            for (int i = graph->in_begin[state]; i < graph->in_begin[state + 1]; i++)
+            {
+                int e = graph->in_edges[i];
+                int from = graph->edge_from[e];
+                if (!graph->terminal[from])
+                {
+                    sum[state] += occupancy[from] * take_probability[e] * value[e];
+                }
+            }
+        }
+    }
 
-    void UpdatePolicy(State *state)
+    // exact statistics -- replace the bookkeeping with what trials trials record on average:
+    // credit[e] is how often per trial the learner credits transition e with a PE, and
+    // credited_PE[e] the PE it credits on average. Counts are rounded; a state's count is the
+    // sum of those of its transitions and a cue's the sum of those of its states, as the
+    // figures expect. The reward averages are exact as long as no cue is seen twice in a trial.
+    void FillExpectedStatistics(int trials, const vector<double> &credit, const vector<double> &credited_PE)
     {
-        if (state->type == PROBABILISTIC)
+        int N = graph->num_states;
+        state_extras.assign(N, StateExtra());
+        transition_extras.assign(graph->num_transitions, TransitionExtra());
+        cue_extras.assign(graph->num_cues, CueExtra());
+        for (int e = 0; e < graph->num_transitions; e++)
         {
-            // no policy for non-choice transitions (i.e. non-deterministic states)
-            return;
+            TransitionExtra &extra = transition_extras[e];
+            extra.times = (int)llround(credit[e] * trials);
+            extra.PE_avg = extra.times > 0 ? credited_PE[e] : 0;
+            state_extras[graph->edge_from[e]].times += extra.times;
         }
-        double total = 0;
-        optimal[state] = GetOptimalChoice(state);
-        for (int i = 0; i < state->out.size(); i++)
+        for (int e = 0; e < graph->num_transitions; e++)
         {
-            Choice* choice = dynamic_cast<Choice*>(state->out[i]);
-            double weight = GetChoiceWeight(choice);
-            policy[choice] = weight;
-            total += weight;
+            int from_times = state_extras[graph->edge_from[e]].times;
+            transition_extras[e].measured_probability = from_times > 0 ? (double)transition_extras[e].times / from_times : 0;
+        }
+
+        // reward to go -- what a trial collects from a state on, the state's own reward included
+        // (as SeeState counts it); one sweep backwards on a forward graph, repeated sweeps otherwise
+        vector<double> to_go(N, 0);
+        bool forward = true;
+        for (int e = 0; e < graph->num_transitions; e++)
+        {
+            forward = forward && graph->edges[e].to > graph->edge_from[e];
         }
-        for (int i = 0; i < state->out.size(); i++)
+        for (int sweep = 0; sweep < 100000; sweep++)
         {
-            Choice* choice = dynamic_cast<Choice*>(state->out[i]);
-            policy[choice] /= total;
+            double change = 0, largest = 1;
+            for (int state = N - 1; state >= 0; state--)
+            {
+                double reward = 0;
+                if (!graph->terminal[state])
+                {
+                    reward = graph->reward[state];
+                    for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+                    {
+                        reward += take_probability[e] * (chain_reward[e] + to_go[graph->edges[e].to]);
+                    }
+                }
+                change = max(change, fabs(reward - to_go[state]));
+                largest = max(largest, fabs(reward));
+                to_go[state] = reward;
+            }
+            if (forward || change < 1e-12 * largest)
+            {
+                break;
+            }
         }
+
+        for (int cue = 0; cue < graph->num_cues; cue++)
+        {
+            CueExtra &extra = cue_extras[cue];
+            double visits = 0;
+            for (int j = graph->cue_states_begin[cue]; j < graph->cue_states_begin[cue + 1]; j++)
+            {
+                int state = graph->cue_states[j];
+                state_extras[state].reward_times = (int)llround(occupancy[state] * trials);
+                state_extras[state].reward_avg = to_go[state];
+                extra.times += state_extras[state].times;
+                extra.reward_avg += occupancy[state] * to_go[state];
+                visits += occupancy[state];
+            }
+            extra.reward_avg = visits > 0 ? extra.reward_avg / visits : 0;
+        }
+        trials_run = trials;
+        stats_version++;
     }
 
     // bookkeeping methods
 
-    void UpdateAveragePE(Transition* trans, double PE)
+    void UpdateAveragePE(int trans, double PE)
     {
-        transition_extras[trans].PE_avg = (transition_extras[trans].PE_avg * transition_extras[trans].times + PE) / (transition_extras[trans].times + 1);
-        transition_extras[trans].times++;
-        state_extras[trans->from].times++;
-        transition_extras[trans].measured_probability = (double)transition_extras[trans].times / state_extras[trans->from].times;
-        transition_extras[trans].PE_avg = PE; // temporary hack -- average in fact shows the last one only 
+        TransitionExtra &extra = transition_extras[trans];
+        StateExtra &from_extra = state_extras[graph->edge_from[trans]];
+        extra.PE_avg = (extra.PE_avg * extra.times + PE) / (extra.times + 1);
+        extra.times++;
+        from_extra.times++;
+        extra.measured_probability = (double)extra.times / from_extra.times;
+        extra.PE_avg = PE; // temporary hack -- average in fact shows the last one only 
     }
 
-    void UpdateAverageReward(Cue* cue, double reward)
+    void UpdateAverageCueReward(int cue, double reward)
     {
-        if (cue == NULL)
+        if (cue == -1)
         {
             return;
         }
-        cue_extras[cue].reward_avg = (cue_extras[cue].reward_avg * cue_extras[cue].times + reward) / (cue_extras[cue].times + 1);
-        cue_extras[cue].times++;
+        CueExtra &extra = cue_extras[cue];
+        extra.reward_avg = (extra.reward_avg * extra.times + reward) / (extra.times + 1);
+        extra.times++;
     }
 
-    void UpdateAverageReward(State *state, double reward)
+    void UpdateAverageStateReward(int state, double reward)
     {
-        if (state == NULL)
+        if (state == -1)
         {
             return;
         }
-        state_extras[state].reward_avg = (state_extras[state].reward_avg * state_extras[state].reward_times + reward) / (state_extras[state].reward_times + 1);
-        state_extras[state].reward_times++;
+        StateExtra &extra = state_extras[state];
+        extra.reward_avg = (extra.reward_avg * extra.reward_times + reward) / (extra.reward_times + 1);
+        extra.reward_times++;
     }
 
-    void Reset()
+    void BeginTrial()
     {
-        policy.clear();
-        state_extras.clear();
-        cue_extras.clear();
-        transition_extras.clear();
-        H.clear();
-        optimal.clear();
-        for (int i = 0; i < model->states.size(); i++)
+        trial_reward = 0;
+    }
+
+    // bookkeeping -- the reward of every state passed counts towards all cues (and cue states) seen so far
+    // edge is the transition taken out of state (which, on a compressed graph, may skip a chain)
+    void SeeState(int state, int edge)
+    {
+        int cue = graph->cue[state];
+        if (cue != -1)
         {
-            State *state = model->states[i];
-            optimal[state] = NULL;
-            state_extras[state] = StateExtra();
-            if (state->type == DETERMINISTIC)
+            if (!cue_seen[cue])
             {
-                double prob_avg = 1.0 / state->out.size();
-                for (int j = 0; j < state->out.size(); j++)
-                {
-                    Choice *choice = dynamic_cast<Choice*>(state->out[j]);
-                    policy[choice] = prob_avg;
-                    optimal[state] = choice;
-                    H[choice] = 0;
-                }
+                cue_seen[cue] = 1;
+                cue_seen_at[cue] = trial_reward;
+                seen_cues.push_back(cue);
+            }
+            if (!state_seen[state])
+            {
+                state_seen[state] = 1;
+                state_seen_at[state] = trial_reward;
+                seen_cue_states.push_back(state);
+            }
+        }
+        trial_reward += graph->reward[state] + chain_reward[edge];
+    }
+
+    // bookkeeping -- update the average reward for all cues (and cue states) passed on this trial
+    void EndTrial()
+    {
+        for (int i = 0; i < seen_cues.size(); i++)
+        {
+            int cue = seen_cues[i];
+            UpdateAverageCueReward(cue, trial_reward - cue_seen_at[cue]);
+            cue_seen[cue] = 0;
+        }
+        for (int i = 0; i < seen_cue_states.size(); i++)
+        {
+            int state = seen_cue_states[i];
+            UpdateAverageStateReward(state, trial_reward - state_seen_at[state]);
+            state_seen[state] = 0;
+        }
+        seen_cues.clear();
+        seen_cue_states.clear();
+        trials_run++;
+        stats_version++;
+    }
+
+    // after ExpandChains moved the tables onto the full graph: fill in the value of every chain
+    // state from the state it always goes to, value[v] = r(next) + gamma value[next]
+    // (the fixed point the macro-edges assume), given the value of every other state
+    void FillChainValues(vector<double> &value)
+    {
+        vector<char> known(graph->num_states);
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            known[state] = !IsChainState(*graph, state);
+        }
+        vector<int> path;
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            path.clear();
+            for (int v = state; !known[v]; v = graph->edges[graph->OutBegin(v)].to)
+            {
+                known[v] = 1;
+                path.push_back(v);
+            }
+            for (int i = (int)path.size() - 1; i >= 0; i--)
+            {
+                const Edge &edge = graph->edges[graph->OutBegin(path[i])];
+                value[path[i]] = edge.reward + gamma * value[edge.to];
             }
         }
-        for (int i = 0; i < model->transitions.size(); i++)
+    }
+
+    // map the learner's own tables from compressed (which graph was compressed from) onto graph
+    virtual void ExpandValues(const CompiledModel *compressed) = 0;
+
+    // the learners extend this with their own tables
+    virtual void Reset()
+    {
+        policy.assign(graph->num_transitions, 0);
+        H.assign(graph->num_transitions, 0);
+        optimal.assign(graph->num_states, -1);
+        state_extras.assign(graph->num_states, StateExtra());
+        transition_extras.assign(graph->num_transitions, TransitionExtra());
+        cue_extras.assign(graph->num_cues, CueExtra());
+        discount.assign(graph->num_transitions, gamma);
+        chain_reward.assign(graph->num_transitions, 0);
+        if (graph->expanded_from != NULL)
         {
-            Transition *trans = model->transitions[i];
-            transition_extras[trans] = TransitionExtra();
+            assert(graph->chain_gamma == gamma);
+            discount = graph->discount;
+            chain_reward = graph->chain_reward;
         }
-        for (int i = 0; i < model->cues.size(); i++)
+        occupancy.assign(graph->num_states, 0);
+        take_probability.assign(graph->num_transitions, 0);
+        trials_run = 0;
+        stats_version++;
+        trial_reward = 0;
+        seen_cues.clear();
+        seen_cues.reserve(graph->num_cues);
+        cue_seen.assign(graph->num_cues, 0);
+        cue_seen_at.assign(graph->num_cues, 0);
+        seen_cue_states.clear();
+        seen_cue_states.reserve(graph->num_states);
+        state_seen.assign(graph->num_states, 0);
+        state_seen_at.assign(graph->num_states, 0);
+        for (int state = 0; state < graph->num_states; state++)
         {
-            Cue *cue = model->cues[i];
-            cue_extras[cue] = CueExtra();
+            if (graph->type[state] == DETERMINISTIC)
+            {
+                double prob_avg = 1.0 / graph->OutDegree(state);
+                for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+                {
+                    policy[e] = prob_avg;
+                    optimal[state] = e;
+                }
+            }
         }
+        ResetPolicyCache();
     }
 
 public:
@@ -210,7 +690,7 @@ public:
         double minimum_action_reward,
         double fraction_wrong_button,
         double epsilon_greedy_constant) :
-        model(experiment_model),
+        graph(&experiment_model->graph),
         eta(critic_learning_rate),
         alpha(actor_learning_rate),
         gamma(discount_factor),
@@ -218,13 +698,213 @@ public:
         beta(softmax_temperature),
         min_R(minimum_action_reward),
         noise(fraction_wrong_button),
-        eps(epsilon_greedy_constant)
+        eps(epsilon_greedy_constant),
+        converged_at(-1),
+        stats_version(0),
+        mean_field(false)
+    {
+    }
+
+    virtual ~RLMethod()
+    {
+    }
+
+    // results only depend on (seed, agent_id), not on what else runs in the process
+    void Seed(uint64_t seed, uint64_t agent_id)
+    {
+        rng.Seed(seed, agent_id);
+    }
+
+    // skip ahead by the given number of random draws
+    void JumpAhead(uint64_t draws)
     {
+        rng.Jump(draws);
     }
 
+    // one trial, traced to cout if do_print
     virtual void Trial(bool do_print) = 0;
 
-    virtual void Print() = 0;
+    // count trials of the concrete learner, traced to trace unless it is NULL
+    virtual void RunBatch(int count, ostream *trace) = 0;
+
+    // count mean-field trials of the concrete learner -- each one deterministic sweep
+    virtual void RunExpectedBatch(int count) = 0;
+
+    // replace the bookkeeping for the figures with exactly what trials trials would record on
+    // average if the tables stayed as they are now -- no sampling, so no noise; the learner
+    // then looks as if it had run trials trials
+    virtual void ExpectStatistics(int trials) = 0;
+
+    // run the mean-field dynamics instead of sampled trials from now on (or stop doing so)
+    // nothing is sampled then, so the bookkeeping for the figures stays where it is
+    void UseMeanField(bool on)
+    {
+        mean_field = on;
+    }
+
+    // count trials; there is one virtual call per batch between progress calls (and looks at
+    // the tables), and only the last options.trace_last trials are traced (mean-field ones never
+    // are). Returns how many trials ran: once the tables converged under options.convergence the
+    // run stops early -- after tracing options.trace_last more trials, so the trace is still there
+    int RunTrials(int count, const RunOptions &options = RunOptions())
+    {
+        const Convergence &criterion = options.convergence;
+        int every = options.progress && options.progress_every > 0 ? options.progress_every : count;
+        int untraced = options.trace != NULL ? max(count - options.trace_last, 0) : count;
+        int done = 0;
+        converged_at = -1;
+        StartConvergence();
+        int stride = criterion.window > 0 ? max(criterion.window / max(criterion.looks, 1), 1) : count;
+        while (done < count)
+        {
+            int stop = min(count, (done / every + 1) * every);
+            stop = min(stop, (done / stride + 1) * stride);
+            if (mean_field)
+            {
+                RunExpectedBatch(stop - done);
+            }
+            else if (done < untraced)
+            {
+                stop = min(stop, untraced);
+                RunBatch(stop - done, NULL);
+            }
+            else
+            {
+                RunBatch(stop - done, options.trace);
+            }
+            done = stop;
+            if (options.progress && options.progress_every > 0 && done % every == 0)
+            {
+                options.progress(done, count);
+            }
+            if (criterion.window > 0 && done % stride == 0)
+            {
+                LookAtTables();
+                if (window_looks >= criterion.looks && Converged(criterion))
+                {
+                    converged_at = done;
+                    break;
+                }
+            }
+        }
+        if (converged_at != -1 && options.trace != NULL && done < untraced)
+        {
+            int traced = min(options.trace_last, count - done);
+            if (mean_field)
+            {
+                RunExpectedBatch(traced);
+            }
+            else
+            {
+                RunBatch(traced, options.trace);
+            }
+            done += traced;
+        }
+        return done;
+    }
+
+    // trials the last RunTrials had run when the tables converged, or -1 if they did not
+    int ConvergedAt() const
+    {
+        return converged_at;
+    }
+
+    // run on run_graph from now on -- e.g. a graph with its chains compressed; starts over
+    void UseGraph(const CompiledModel *run_graph)
+    {
+        graph = run_graph;
+        Reset();
+    }
+
+    // if the learner runs on a compressed graph, move all its tables and statistics onto the
+    // graph it was compressed from (no-op otherwise), so Morris and Print see every original
+    // state and edge; it keeps learning on the full graph afterwards
+    //
+    // the first edge of every macro-edge gets its table entries and statistics; the chain
+    // states get the values they have at the fixed point the macro-edges assume, and the rest
+    // of the edges of a chain are counted as taken every time the macro-edge was, with PE 0 --
+    // the PE they have at that fixed point
+    void ExpandChains()
+    {
+        const CompiledModel *compressed = graph;
+        const CompiledModel *full = compressed->expanded_from;
+        if (full == NULL)
+        {
+            return;
+        }
+        RefreshPolicies();
+
+        vector<double> full_policy(full->num_transitions, 0);
+        vector<double> full_H(full->num_transitions, 0);
+        vector<int> full_optimal(full->num_states, -1);
+        vector<StateExtra> full_state_extras(full->num_states);
+        vector<TransitionExtra> full_transition_extras(full->num_transitions);
+        for (int state = 0; state < compressed->num_states; state++)
+        {
+            int origin = compressed->state_origin[state];
+            int opt = optimal[state];
+            full_optimal[origin] = opt != -1 ? compressed->origin_edges[compressed->origin_begin[opt]] : -1;
+            full_state_extras[origin] = state_extras[state];
+        }
+        for (int e = 0; e < compressed->num_transitions; e++)
+        {
+            int first = compressed->origin_edges[compressed->origin_begin[e]];
+            full_policy[first] = policy[e];
+            full_H[first] = H[e];
+            full_transition_extras[first] = transition_extras[e];
+            for (int i = compressed->origin_begin[e] + 1; i < compressed->origin_begin[e + 1]; i++)
+            {
+                int trans = compressed->origin_edges[i];
+                full_transition_extras[trans].times += transition_extras[e].times;
+                full_state_extras[full->edge_from[trans]].times += transition_extras[e].times;
+            }
+        }
+        for (int i = 0; i < compressed->start_chain.size(); i++)
+        {
+            int trans = compressed->start_chain[i];
+            full_transition_extras[trans].times += trials_run;
+            full_state_extras[full->edge_from[trans]].times += trials_run;
+        }
+        for (int state = 0; state < full->num_states; state++)
+        {
+            if (IsChainState(*full, state) && full_state_extras[state].times > 0)
+            {
+                full_transition_extras[full->OutBegin(state)].measured_probability = 1;
+            }
+        }
+
+        graph = full;
+        policy.swap(full_policy);
+        H.swap(full_H);
+        optimal.swap(full_optimal);
+        state_extras.swap(full_state_extras);
+        transition_extras.swap(full_transition_extras);
+        stats_version++;
+        discount.assign(graph->num_transitions, gamma);
+        chain_reward.assign(graph->num_transitions, 0);
+        state_seen.assign(graph->num_states, 0);
+        state_seen_at.assign(graph->num_states, 0);
+        seen_cue_states.reserve(graph->num_states);
+        occupancy.assign(graph->num_states, 0);
+        take_probability.assign(graph->num_transitions, 0);
+        ExpandValues(compressed);
+        ResetPolicyCache();
+    }
+
+    // bring the policy of every state up to date, e.g. before reading it
+    virtual void RefreshPolicies() = 0;
+
+    // the learner's own value table -- V by state id (actor-critic) or Q by transition id
+    virtual const vector<double>& Values() = 0;
+
+    // the current policy by transition id (0 on chance edges), e.g. for the Solver to evaluate
+    const vector<double>& Policy()
+    {
+        RefreshPolicies();
+        return policy;
+    }
+
+    virtual void Print(ostream &out = cout) = 0;
 
 };
 
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <sys/resource.h>
+
+#include "graph-loader.h"
+#include "rl-config.h"
+
+// run-graph graph.txt [-s start]... [-t terminal]... [-l ac|sarsa|q] [-u sampled|mean-field] [-n trials]
+// loads a task file of any shape with GraphLoader and runs one learner on it; without -s (-t)
+// trials start (end) in every state with no way in (out). Prints one line of size, load time,
+// speed and memory.
+int main(int argc, char **argv)
+{
+    GraphEndpoints endpoints;
+    RLConfig config;
+    config.learner = LEARNER_SARSA;
+    int trials = 1000;
+    string path;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg[0] != '-')
+        {
+            path = arg;
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            cerr<<"Option "<<arg<<" needs a value.\n";
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "-s")
+        {
+            endpoints.starts.push_back(value);
+        }
+        else if (arg == "-t")
+        {
+            endpoints.terminals.push_back(value);
+        }
+        else if (arg == "-l" && (value == "ac" || value == "sarsa" || value == "q"))
+        {
+            config.learner = value == "ac" ? LEARNER_ACTOR_CRITIC : value == "sarsa" ? LEARNER_SARSA : LEARNER_Q_LEARNING;
+        }
+        else if (arg == "-u" && (value == "sampled" || value == "mean-field"))
+        {
+            config.mean_field = value == "mean-field";
+        }
+        else if (arg == "-n")
+        {
+            trials = atoi(value.c_str());
+        }
+        else
+        {
+            path = "";
+            break;
+        }
+    }
+    if (path.empty())
+    {
+        cerr<<"Usage: "<<argv[0]<<" graph.txt [-s start]... [-t terminal]... [-l ac|sarsa|q] [-u sampled|mean-field] [-n trials]\n";
+        return 1;
+    }
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    ExperimentalModel *model = new ExperimentalModel();
+    TaskError error;
+    if (!LoadGraphFile(model, path, endpoints, error))
+    {
+        cerr<<error.ToString()<<"\n";
+        return 1;
+    }
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    if (model->graph.start_states.empty())
+    {
+        cerr<<path<<": no start state\n";
+        return 1;
+    }
+
+    RLMethod *rl_method = CreateRLMethod(model, config);
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+    rl_method->RunTrials(trials);
+    chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const CompiledModel &graph = model->graph;
+    cout<<"% states transitions starts load_s edge_array_bytes trials trials_per_s max_rss_kb\n";
+    cout<<graph.num_states<<" "<<graph.num_transitions<<" "<<graph.start_states.size()<<" "<<chrono::duration<double>(t1 - t0).count()<<" ";
+    cout<<graph.edges.size() * sizeof(Edge)<<" "<<trials<<" "<<trials / chrono::duration<double>(t3 - t2).count()<<" "<<usage.ru_maxrss<<"\n";
+    return 0;
+}
@@ -3,54 +3,125 @@
 
 #include "rl-method.h"
 
-class SARSA : public RLMethod
+// tables, policy inputs and printing -- everything that does not depend on
+// the action selection method; shared by SARSA and QLearning
+class SARSABase : public RLMethod
 {
 protected:
-    map<Transition*, double> Q;
+    friend class RLMethod;
 
-    Choice* GetOptimalChoice(State *state)
+    vector<double> Q; // by transition id
+    vector<double> continuation; // by state id; mean-field scratch
+
+    int GetOptimalChoice(int state)
     {
-        if (state->type == PROBABILISTIC)
+        if (graph->type[state] == PROBABILISTIC)
         {
-            return NULL;
+            return -1;
         }
-        Transition* result = NULL;
+        int result = -1;
         double Q_max = -1e100;
-        for (int i = 0; i < state->out.size(); i++)
+        for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
         {
-            Transition *trans = state->out[i];
-            if (Q[trans] > Q_max)
+            if (Q[e] > Q_max)
             {
-                result = trans;
-                Q_max = Q[trans];
+                result = e;
+                Q_max = Q[e];
             }
         }
-        return dynamic_cast<Choice*>(result);
+        return result;
+    }
+
+    double ChoicePreference(int choice)
+    {
+        return Q[choice];
+    }
+
+    double ChoiceValue(int choice)
+    {
+        return Q[choice];
     }
 
-    double GetChoiceWeight(Choice *choice)
+    // what the Q of a transition into state is updated towards, besides its reward, on average --
+    // the Q of the next transition as SARSA picks it (0 out of a terminal state)
+    virtual double ContinuationValue(int state)
     {
-        switch(method)
+        if (graph->terminal[state])
         {
-            case SOFTMAX:
-            {
-                return exp(beta * Q[choice]);
-            }
-            case PROBABILITY_MATCHING:
+            return 0;
+        }
+        int num_choices = graph->OutDegree(state);
+        double value = 0, total = 0, mean = 0;
+        for (int e = graph->OutBegin(state); e < graph->OutEnd(state); e++)
+        {
+            double weight = graph->type[state] == DETERMINISTIC ? policy[e] : graph->edges[e].Probability();
+            value += weight * Q[e];
+            total += weight;
+            mean += Q[e] / num_choices;
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+        value /= total;
+        return graph->type[state] == DETERMINISTIC ? (1 - noise) * value + noise * mean : value;
+    }
+
+    // one mean-field trial: every Q moves by its expected update towards reward plus
+    // ContinuationValue, and with update_H every choice also by its expected actor update,
+    // all computed from the tables as they were when the trial began
+    template <class Learner>
+    void ExpectedTrial(bool update_H)
+    {
+        ExpectedVisits<Learner>();
+        continuation.resize(graph->num_states);
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            continuation[state] = ContinuationValue(state);
+        }
+        for (int S = 0; S < graph->num_states; S++)
+        {
+            if (graph->terminal[S] || occupancy[S] == 0)
             {
-                return max(Q[choice], min_R);
+                continue;
             }
-            case EPS_GREEDY:
+            for (int a = graph->OutBegin(S); a < graph->OutEnd(S); a++)
             {
-                if (choice == optimal[choice->from])
+                const Edge &edge = graph->edges[a];
+                double PE = edge.reward + discount[a] * continuation[edge.to] - Q[a];
+                double weight = occupancy[S] * take_probability[a];
+                Q[a] += eta * weight * PE;
+                if (update_H && graph->type[S] == DETERMINISTIC)
                 {
-                    return 1 - eps;
+                    H[a] += alpha * weight * PE;
                 }
-                return eps / choice->from->out.size();
             }
-            default:
+        }
+        MarkPoliciesStale();
+    }
+
+    void ExpandValues(const CompiledModel *compressed)
+    {
+        vector<double> full_Q(graph->num_transitions, 0);
+        for (int e = 0; e < compressed->num_transitions; e++)
+        {
+            full_Q[compressed->origin_edges[compressed->origin_begin[e]]] = Q[e];
+        }
+        Q.swap(full_Q);
+        vector<double> value(graph->num_states, 0);
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            if (!IsChainState(*graph, state))
             {
-                return -1e100;
+                value[state] = ContinuationValue(state);
+            }
+        }
+        FillChainValues(value);
+        for (int state = 0; state < graph->num_states; state++)
+        {
+            if (IsChainState(*graph, state))
+            {
+                Q[graph->OutBegin(state)] = value[state];
             }
         }
     }
@@ -60,15 +131,10 @@ public:
     void Reset()
     {
         RLMethod::Reset();
-        Q.clear();
-        for (int i = 0; i < model->transitions.size(); i++)
-        {
-            Transition *trans = model->transitions[i];
-            Q[trans] = 0;
-        }
+        Q.assign(graph->num_transitions, 0);
     }
 
-    SARSA(ExperimentalModel *experiment_model,
+    SARSABase(ExperimentalModel *experiment_model,
         double critic_learning_rate,
         double actor_learning_rate,
         double discount_factor,
@@ -94,61 +160,120 @@ public:
         Reset();
     }
 
-    virtual void Trial(bool do_print)
+    const vector<double>& Values()
     {
-        if (do_print) cout<<"\n  ---------------------- TRIAL --------------\n\n";
-        State *S = model->start;
-        Transition *A = PickTransition(S);
+        return Q;
+    }
+
+    void Print(ostream &out = cout)
+    {
+        RefreshPolicies();
+        out<<"\n  States:\n";
+        for (int i = 0; i < graph->num_states; i++)
+        {
+            int state = graph->state_order[i];
+            int opt = optimal[state];
+            out<<"    optimal["<<graph->state_name[state]<<"] = "<<(opt != -1 ? graph->action_name[graph->edges[opt].Action()] : "None")<<", times = "<<state_extras[state].times<<", reward_avg = "<<state_extras[state].reward_avg<<", reward times = "<<state_extras[state].reward_times<<"\n";
+        }
+        out<<"\n  Transitions:\n";
+        for (int i = 0; i < graph->num_transitions; i++)
+        {
+            int trans = graph->transition_order[i];
+            int from = graph->edge_from[trans];
+            out<<"     Q["<<graph->state_name[from]<<" -> "<<graph->state_name[graph->edges[trans].to]<<"] = "<<Q[trans]<<": ";
+            if (graph->type[from] == DETERMINISTIC)
+            {
+                out<<"         ("<<graph->action_name[graph->edges[trans].Action()]<<")               policy = "<<policy[trans]<<", H = "<<H[trans];
+            }
+            out<<", PE_avg = "<<transition_extras[trans].PE_avg<<", times = "<<transition_extras[trans].times<<", measured prob = "<<transition_extras[trans].measured_probability;
+            out<<"\n";
+        }
+        out<<"\n  Cue\n";
+        for (int cue = 0; cue < graph->num_cues; cue++)
+        {
+            out<<"    "<<graph->cue_name[cue]<<": reward_avg = "<<cue_extras[cue].reward_avg<<", times = "<<cue_extras[cue].times<<"\n";
+        }
+        out<<"\n";
+    }
+
+};
+
+
+// SARSA specialised at compile time on its Selection policy --
+// Softmax, ProbabilityMatching or EpsGreedy (action-selection.h)
+template <class SelectionPolicy>
+class SARSA : public SARSABase
+{
+public:
+    typedef SelectionPolicy Selection;
+
+    SARSA(ExperimentalModel *experiment_model,
+        double critic_learning_rate,
+        double actor_learning_rate,
+        double discount_factor,
+        double softmax_temperature,
+        double minimum_action_reward,
+        double fraction_wrong_button,
+        double epsilon_greedy_constant) :
+        SARSABase(experiment_model,
+        critic_learning_rate,
+        actor_learning_rate,
+        discount_factor,
+        Selection::method,
+        softmax_temperature,
+        minimum_action_reward,
+        fraction_wrong_button,
+        epsilon_greedy_constant)
+    { }
+
+    // one trial; the trace is compiled out unless traced
+    template <bool traced>
+    void RunTrial(ostream &out)
+    {
+        if (traced) out<<"\n  ---------------------- TRIAL --------------\n\n";
+        int S = StartState();
+        int A = PickTransition<SARSA>(S);
 
         double PE_prev = 0, PE_prev_prev = 0;
-        map<Cue*, double> seen_cues;
-        map<State*, double> seen_cue_states;
-        while (S != model->end)
+        BeginTrial();
+        while (!graph->terminal[S])
         {
-            State *S_new = A->to;
-            Transition *A_new = PickTransition(S_new);
+            int S_new = graph->edges[A].to;
+            int A_new = PickTransition<SARSA>(S_new);
+            if (graph->terminal[S_new])
+            {
+                A_new = -1; // the trial is over, whatever edges lead on
+            }
 
-            double R_new = S_new->reward;
-            double PE = R_new + gamma * Q[A_new] - Q[A];
+            double R_new = graph->edges[A].reward;
+            double Q_new = A_new != -1 ? Q[A_new] : 0; // no action out of a terminal state
+            double PE = R_new + discount[A] * Q_new - Q[A];
+            if (graph->type[S] == DETERMINISTIC)
+            {
+                InvalidatePolicy<SARSA>(S);
+            }
             Q[A] += eta * PE;
 
             // update policy
             // TODO investigate why the fuck this has to be _new in order to work as A/C
             // not that we need it anyway
             /*
-            if (S_new->type == DETERMINISTIC)
+            if (graph->type[S_new] == DETERMINISTIC)
             {
-                H[dynamic_cast<Choice*>(A_new)] += alpha * PE;
+                H[A_new] += alpha * PE;
             }
             */
             UpdatePolicy(S);
-            if (do_print) cout<<" from "<<S->name<<" (Q="<<Q[A]<<") to "<<S_new->name<<" (Q="<<Q[A_new]<<"), PE = "<<PE<<"\n";
+            if (traced) out<<" from "<<graph->state_name[S]<<" (Q="<<Q[A]<<") to "<<graph->state_name[S_new]<<" (Q="<<Q_new<<"), PE = "<<PE<<"\n";
 
             // bookkeeping -- average PE per action & prob of chosing this action
-            if (A_new)
+            if (A_new != -1)
             {
                 UpdateAveragePE(A_new, PE + PE_prev + PE_prev_prev);
             }
 
-            // bookkeeping -- average reward received per seen cue
-            if (S->cue != NULL && seen_cues.find(S->cue) == seen_cues.end())
-            {
-                seen_cues[S->cue] = 0;
-            }
-            for (map<Cue*, double>::iterator it = seen_cues.begin(); it != seen_cues.end(); it++)
-            {
-                it->second += S->reward;
-            }
-
-            // bookkeeping -- average reward received per seen cue state (similar to above)
-            if (S->cue != NULL && seen_cue_states.find(S) == seen_cue_states.end())
-            {
-                seen_cue_states[S] = 0;
-            }
-            for (map<State*, double>::iterator it = seen_cue_states.begin(); it != seen_cue_states.end(); it++)
-            {
-                it->second += S->reward;
-            }
+            // bookkeeping -- average reward received per seen cue (and cue state)
+            SeeState(S, A);
           
             // move to new state
             //PE_prev_prev = PE_prev;
@@ -156,46 +281,82 @@ public:
             S = S_new;
             A = A_new;
         }
-        // bookkeeping -- update the average reward for all cues passed on this trial
-        for (map<Cue*, double>::iterator it = seen_cues.begin(); it != seen_cues.end(); it++)
+        EndTrial();
+    }
+
+    void Trial(bool do_print)
+    {
+        if (do_print)
+        {
+            RunTrial<true>(cout);
+        }
+        else
+        {
+            RunTrial<false>(cout);
+        }
+    }
+
+    // SARSA credits the PE of a step to the transition taken after it, so every transition
+    // but the first of a trial gets R + gamma Q(it) - Q(the one before), averaged over the
+    // transitions that lead to its state
+    void ExpectStatistics(int trials)
+    {
+        ExpectedVisits<SARSA>();
+        int T = graph->num_transitions;
+        vector<double> ones(T, 1), reward_less_Q(T), arrivals, base, discounted;
+        vector<double> credit(T, 0), credited_PE(T, 0);
+        for (int e = 0; e < T; e++)
         {
-            UpdateAverageReward(it->first, it->second);
+            reward_less_Q[e] = graph->edges[e].reward - Q[e];
         }
-        // bookkeeping -- same for cue states
-        for (map<State*, double>::iterator it = seen_cue_states.begin(); it != seen_cue_states.end(); it++)
+        Inflow(ones, arrivals);
+        Inflow(reward_less_Q, base);
+        Inflow(discount, discounted);
+        for (int S = 0; S < graph->num_states; S++)
         {
-            UpdateAverageReward(it->first, it->second);
+            if (graph->terminal[S] || arrivals[S] == 0)
+            {
+                continue;
+            }
+            for (int a = graph->OutBegin(S); a < graph->OutEnd(S); a++)
+            {
+                credit[a] = arrivals[S] * take_probability[a];
+                credited_PE[a] = (base[S] + discounted[S] * Q[a]) / arrivals[S];
+            }
         }
+        FillExpectedStatistics(trials, credit, credited_PE);
+        MarkPoliciesStale();
     }
 
-    void Print()
+    void RunExpectedBatch(int count)
     {
-        cout<<"\n  States:\n";
-        for (int i = 0; i < model->states.size(); i++)
+        for (int i = 0; i < count; i++)
         {
-            State *state = model->states[i];
-            cout<<"    optimal["<<state->name<<"] = "<<(optimal[state] ? optimal[state]->name : "None")<<", times = "<<state_extras[state].times<<", reward_avg = "<<state_extras[state].reward_avg<<", reward times = "<<state_extras[state].reward_times<<"\n";
+            ExpectedTrial<SARSA>(false);
         }
-        cout<<"\n  Transitions:\n";
-        for (int i = 0; i < model->transitions.size(); i++)
+    }
+
+    void RunBatch(int count, ostream *trace)
+    {
+        if (trace == NULL)
         {
-            Transition *trans = model->transitions[i];
-            cout<<"     Q["<<trans->from->name<<" -> "<<trans->to->name<<"] = "<<Q[trans]<<": ";
-            if (trans->from->type == DETERMINISTIC)
+            for (int i = 0; i < count; i++)
             {
-                Choice *choice = dynamic_cast<Choice*>(trans);
-                cout<<"         ("<<choice->name<<")               policy = "<<policy[choice]<<", H = "<<H[choice];
+                RunTrial<false>(cout);
             }
-            cout<<", PE_avg = "<<transition_extras[trans].PE_avg<<", times = "<<transition_extras[trans].times<<", measured prob = "<<transition_extras[trans].measured_probability;
-            cout<<"\n";
         }
-        cout<<"\n  Cue\n";
-        for (int i = 0; i < model->cues.size(); i++)
+        else
         {
-            Cue* cue = model->cues[i];
-            cout<<"    "<<cue->name<<": reward_avg = "<<cue_extras[cue].reward_avg<<", times = "<<cue_extras[cue].times<<"\n";
+            for (int i = 0; i < count; i++)
+            {
+                RunTrial<true>(*trace);
+            }
         }
-        cout<<"\n";
+    }
+
+    void RefreshPolicies()
+    {
+        RefreshAllPolicies<SARSA>();
     }
 
 };
@@ -0,0 +1,130 @@
+#include <chrono>
+
+#include "rl-config.h"
+#include "model-file.h"
+#include "graph-loader.h"
+#include "solver.h"
+
+// solve task.txt [-m evaluate|optimal|matching] [-l ac|sarsa|q] [-n trials] [-g gamma] [-r min_R] [-e noise] [-w workers] [-o tables|summary] [-i task|graph]
+// where the learners' values end up, without sampling (solver.h): evaluate takes the policy of
+// learner -l after -n trials (0, the default, is the uniform policy of a fresh one), matching weighs
+// the choices by that learner's ChoiceValue (V of the next state for ac, Q otherwise). Prints the
+// tables the way the learners' Print does, or one line of size, sweeps and time. With -i graph the
+// file is read by GraphLoader (any shape, trials from the states with no way in to those with no way out).
+int main(int argc, char **argv)
+{
+    RLConfig config;
+    string mode = "matching";
+    string output = "tables";
+    string input = "task";
+    int trials = 0;
+    int workers = WorkStealingPool::DefaultWorkers();
+    string path;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg[0] != '-')
+        {
+            path = arg;
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            cerr<<"Option "<<arg<<" needs a value.\n";
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "-m" && (value == "evaluate" || value == "optimal" || value == "matching"))
+        {
+            mode = value;
+        }
+        else if (arg == "-l" && (value == "ac" || value == "sarsa" || value == "q"))
+        {
+            config.learner = value == "ac" ? LEARNER_ACTOR_CRITIC : value == "sarsa" ? LEARNER_SARSA : LEARNER_Q_LEARNING;
+        }
+        else if (arg == "-n")
+        {
+            trials = atoi(value.c_str());
+        }
+        else if (arg == "-g")
+        {
+            config.gamma = atof(value.c_str());
+        }
+        else if (arg == "-r")
+        {
+            config.min_R = atof(value.c_str());
+        }
+        else if (arg == "-e")
+        {
+            config.noise = atof(value.c_str());
+        }
+        else if (arg == "-w")
+        {
+            workers = atoi(value.c_str());
+        }
+        else if (arg == "-o" && (value == "tables" || value == "summary"))
+        {
+            output = value;
+        }
+        else if (arg == "-i" && (value == "task" || value == "graph"))
+        {
+            input = value;
+        }
+        else
+        {
+            path = "";
+            break;
+        }
+    }
+    if (path.empty())
+    {
+        cerr<<"Usage: "<<argv[0]<<" task.txt [-m evaluate|optimal|matching] [-l ac|sarsa|q] [-n trials] [-g gamma] [-r min_R] [-e noise] [-w workers] [-o tables|summary] [-i task|graph]\n";
+        return 1;
+    }
+
+    ExperimentalModel *model = new ExperimentalModel();
+    TaskError error;
+    bool ok = input == "graph" ? LoadGraphFile(model, path, GraphEndpoints(), error) : LoadModelCached(model, path, error);
+    if (!ok)
+    {
+        cerr<<error.ToString()<<"\n";
+        return 1;
+    }
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    Solver solver(&model->graph, config.gamma, config.min_R, config.noise, workers);
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    chrono::steady_clock::time_point t2 = t1;
+    SolverResult result;
+    if (mode == "evaluate")
+    {
+        RLMethod *rl_method = CreateRLMethod(model, config);
+        rl_method->RunTrials(trials);
+        t2 = chrono::steady_clock::now();
+        result = solver.Evaluate(rl_method->Policy());
+    }
+    else if (mode == "optimal")
+    {
+        result = solver.Optimal();
+    }
+    else
+    {
+        result = solver.Matching(config.learner == LEARNER_ACTOR_CRITIC ? MATCH_NEXT_V : MATCH_Q);
+    }
+    chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
+
+    if (!result.converged)
+    {
+        cerr<<path<<": no convergence after "<<result.sweeps<<" sweeps (residual "<<result.residual<<")\n";
+    }
+    if (output == "tables")
+    {
+        solver.Print();
+        return 0;
+    }
+    const CompiledModel &graph = model->graph;
+    cout<<"% states transitions levels sweeps residual level_s solve_s start_value\n";
+    cout<<graph.num_states<<" "<<graph.num_transitions<<" "<<solver.NumLevels()<<" "<<result.sweeps<<" "<<result.residual<<" ";
+    cout<<chrono::duration<double>(t1 - t0).count()<<" "<<chrono::duration<double>(t3 - t2).count()<<" "<<solver.StartValue()<<"\n";
+    return 0;
+}
@@ -0,0 +1,382 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <vector>
+#include <cmath>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+
+#include "compiled-model.h"
+#include "thread-pool.h"
+
+using namespace std;
+
+// what probability matching weighs a choice by -- the learner's ChoiceValue
+enum MatchedValue
+{
+    MATCH_NEXT_V, // V of the state the choice leads to (ActorCritic)
+    MATCH_Q       // Q of the choice (SARSA)
+};
+
+// how a solve ended
+struct SolverResult
+{
+    int sweeps;      // passes over the states; 1 on a graph without cycles
+    double residual; // largest change of V in the last sweep
+    bool converged;  // residual got below the tolerance (always, without cycles)
+
+    SolverResult() :
+        sweeps(0),
+        residual(0),
+        converged(false)
+    { }
+};
+
+
+// the values a learner converges to on a compiled graph, computed without running a single trial
+//
+//   Evaluate -- V and Q of a given policy, as the critic (ActorCritic V, SARSA Q) learns them
+//   Optimal  -- value iteration: the best choice everywhere, which is what QLearning's Q learns
+//   Matching -- the fixed point of probability matching, where the policy of every choice is
+//               proportional to max(value, min_R) and the value is that of the policy itself
+// Evaluate and Matching take the wrong button presses (noise) into account, as the learners do;
+// Optimal does not, since Q-learning backs up the best continuation whatever gets pressed.
+//
+// Every backup is one sparse row of the CSR graph: V[s] = sum over out-edges of take probability
+// * (reward + discount * V[to]), 0 at terminal states. The states are levelled once by their
+// longest way to a terminal state; without cycles, a level depends only on lower ones, so one
+// pass up the levels is exact (and so is Matching, whose policy only looks one step ahead).
+// With cycles every sweep is a Jacobi step from the last V until the largest change is below
+// the tolerance. Either way the states of a sweep (or level) are split into chunks for the pool.
+class Solver
+{
+private:
+    const CompiledModel *graph;
+    double gamma;
+    double min_R;
+    double noise;
+    WorkStealingPool pool;
+
+    vector<double> discount;  // by transition id; gamma, or gamma^k on a macro-edge
+    vector<int> level_begin;  // states of level l are level_states[level_begin[l] .. level_begin[l + 1])
+    vector<int> level_states;
+    bool acyclic;
+
+    // what the current solve backs up
+    enum Mode
+    {
+        EVALUATE,
+        OPTIMAL,
+        MATCHING
+    };
+    Mode mode;
+    MatchedValue matched;
+    const vector<double> *given_policy;
+
+    vector<double> V_next;         // Jacobi buffer
+    vector<double> chunk_residual; // by chunk of a sweep
+
+    static const int chunk = 4096; // states per task
+
+    double Target(int e, const vector<double> &values) const
+    {
+        const Edge &edge = graph->edges[e];
+        return edge.reward + discount[e] * values[edge.to];
+    }
+
+    // the new V of state from the values of its successors; sets the policy of its choices
+    // (each state is backed up by one task, so the writes never overlap)
+    double Backup(int state, const vector<double> &values)
+    {
+        int begin = graph->OutBegin(state), end = graph->OutEnd(state);
+        if (graph->terminal[state] || begin == end)
+        {
+            return 0;
+        }
+        double value = 0, total = 0;
+        if (graph->type[state] == PROBABILISTIC)
+        {
+            for (int e = begin; e < end; e++)
+            {
+                value += graph->edges[e].Probability() * Target(e, values);
+                total += graph->edges[e].Probability();
+            }
+            return value / total;
+        }
+        if (mode == OPTIMAL)
+        {
+            int best = begin;
+            for (int e = begin; e < end; e++)
+            {
+                policy[e] = 0;
+                if (Target(e, values) > Target(best, values))
+                {
+                    best = e;
+                }
+            }
+            policy[best] = 1;
+            return Target(best, values);
+        }
+        for (int e = begin; e < end; e++)
+        {
+            if (mode == EVALUATE)
+            {
+                policy[e] = (*given_policy)[e];
+            }
+            else
+            {
+                policy[e] = max(matched == MATCH_Q ? Target(e, values) : values[graph->edges[e].to], min_R);
+            }
+            total += policy[e];
+        }
+        int num_choices = end - begin;
+        for (int e = begin; e < end; e++)
+        {
+            // a policy with nothing on any choice is taken as uniform, like a fresh learner's
+            policy[e] = total > 0 ? policy[e] / total : 1.0 / num_choices;
+            value += ((1 - noise) * policy[e] + noise / num_choices) * Target(e, values);
+        }
+        return value;
+    }
+
+    // run(first, last) over [0, count) in chunks, on the pool if there is more than one chunk
+    template <class Body>
+    void ForChunks(int count, const Body &run)
+    {
+        int num_chunks = (count + chunk - 1) / chunk;
+        if (num_chunks <= 1)
+        {
+            if (count > 0)
+            {
+                run(0, 0, count);
+            }
+            return;
+        }
+        pool.Run(num_chunks, [&](int c)
+        {
+            run(c, c * chunk, min(count, (c + 1) * chunk));
+        });
+    }
+
+    // level every state by its longest way to a terminal state (Kahn's algorithm over the
+    // in-edges, from the terminal states and dead ends up); acyclic unless some state is left over
+    void Levels()
+    {
+        int N = graph->num_states;
+        vector<int> pending(N), level(N, 0), order;
+        order.reserve(N);
+        for (int state = 0; state < N; state++)
+        {
+            pending[state] = graph->terminal[state] ? 0 : graph->OutDegree(state);
+            if (pending[state] == 0)
+            {
+                order.push_back(state);
+            }
+        }
+        for (int i = 0; i < order.size(); i++)
+        {
+            int state = order[i];
+            for (int j = graph->in_begin[state]; j < graph->in_begin[state + 1]; j++)
+            {
+                int from = graph->edge_from[graph->in_edges[j]];
+                if (graph->terminal[from])
+                {
+                    continue;
+                }
+                level[from] = max(level[from], level[state] + 1);
+                if (--pending[from] == 0)
+                {
+                    order.push_back(from);
+                }
+            }
+        }
+        acyclic = order.size() == N;
+        level_begin.clear();
+        level_states.clear();
+        if (!acyclic)
+        {
+            return;
+        }
+        int num_levels = 0;
+        for (int state = 0; state < N; state++)
+        {
+            num_levels = max(num_levels, level[state] + 1);
+        }
+        level_begin.assign(num_levels + 1, 0);
+        for (int state = 0; state < N; state++)
+        {
+            level_begin[level[state] + 1]++;
+        }
+        for (int l = 0; l < num_levels; l++)
+        {
+            level_begin[l + 1] += level_begin[l];
+        }
+        level_states.resize(N);
+        vector<int> next(level_begin.begin(), level_begin.end() - 1);
+        for (int state = 0; state < N; state++)
+        {
+            level_states[next[level[state]]++] = state;
+        }
+    }
+
+    SolverResult Solve(double tolerance, int max_sweeps)
+    {
+        SolverResult result;
+        int N = graph->num_states;
+        if (acyclic)
+        {
+            for (int l = 0; l + 1 < level_begin.size(); l++)
+            {
+                const int *states = &level_states[level_begin[l]];
+                ForChunks(level_begin[l + 1] - level_begin[l], [&](int /*chunk*/, int first, int last)
+                {
+                    for (int i = first; i < last; i++)
+                    {
+                        V[states[i]] = Backup(states[i], V);
+                    }
+                });
+            }
+            result.sweeps = 1;
+            result.converged = true;
+        }
+        else
+        {
+            V_next.resize(N);
+            chunk_residual.assign((N + chunk - 1) / chunk, 0);
+            while (result.sweeps < max_sweeps && !result.converged)
+            {
+                ForChunks(N, [&](int c, int first, int last)
+                {
+                    double residual = 0;
+                    for (int state = first; state < last; state++)
+                    {
+                        V_next[state] = Backup(state, V);
+                        residual = max(residual, fabs(V_next[state] - V[state]));
+                    }
+                    chunk_residual[c] = residual;
+                });
+                V.swap(V_next);
+                result.sweeps++;
+                result.residual = *max_element(chunk_residual.begin(), chunk_residual.end());
+                result.converged = result.residual <= tolerance;
+            }
+        }
+
+        int T = graph->num_transitions;
+        ForChunks(T, [&](int /*chunk*/, int first, int last)
+        {
+            for (int e = first; e < last; e++)
+            {
+                Q[e] = Target(e, V);
+            }
+        });
+        return result;
+    }
+
+public:
+    vector<double> V;      // by state id
+    vector<double> Q;      // by transition id; reward + discount * V of the target
+    vector<double> policy; // by transition id; of the choices before noise, 0 on chance edges
+
+    Solver(const CompiledModel *task_graph,
+        double discount_factor,
+        double minimum_action_reward,
+        double fraction_wrong_button,
+        int workers = WorkStealingPool::DefaultWorkers()) :
+        graph(task_graph),
+        gamma(discount_factor),
+        min_R(minimum_action_reward),
+        noise(fraction_wrong_button),
+        pool(workers),
+        mode(EVALUATE),
+        matched(MATCH_NEXT_V),
+        given_policy(NULL)
+    {
+        discount.assign(graph->num_transitions, gamma);
+        if (graph->expanded_from != NULL)
+        {
+            assert(graph->chain_gamma == gamma);
+            discount = graph->discount;
+        }
+        V.assign(graph->num_states, 0);
+        Q.assign(graph->num_transitions, 0);
+        policy.assign(graph->num_transitions, 0);
+        Levels();
+    }
+
+    // whether one pass solves the graph exactly (no cycles among its non-terminal states)
+    bool Acyclic() const
+    {
+        return acyclic;
+    }
+
+    int NumLevels() const
+    {
+        return acyclic ? level_begin.size() - 1 : 0;
+    }
+
+    // V and Q of choice_policy (by transition id, normalised per state here; the learners'
+    // policy, or anything else); a solve with cycles starts from the V of the last one
+    SolverResult Evaluate(const vector<double> &choice_policy, double tolerance = 1e-9, int max_sweeps = 100000)
+    {
+        assert(choice_policy.size() == graph->num_transitions);
+        mode = EVALUATE;
+        given_policy = &choice_policy;
+        SolverResult result = Solve(tolerance, max_sweeps);
+        given_policy = NULL;
+        return result;
+    }
+
+    SolverResult Optimal(double tolerance = 1e-9, int max_sweeps = 100000)
+    {
+        mode = OPTIMAL;
+        return Solve(tolerance, max_sweeps);
+    }
+
+    // with cycles this is a plain fixed-point iteration, which need not converge;
+    // the result says whether it did
+    SolverResult Matching(MatchedValue value = MATCH_NEXT_V, double tolerance = 1e-9, int max_sweeps = 100000)
+    {
+        mode = MATCHING;
+        matched = value;
+        return Solve(tolerance, max_sweeps);
+    }
+
+    // expected return of a trial, over the start states
+    double StartValue() const
+    {
+        double value = 0;
+        for (int i = 0; i < graph->start_states.size(); i++)
+        {
+            value += V[graph->start_states[i]];
+        }
+        return graph->start_states.empty() ? 0 : value / graph->start_states.size();
+    }
+
+    // the lines of ActorCritic::Print (V) and SARSA::Print (Q, policy), so they can be set side by side
+    void Print(ostream &out = cout)
+    {
+        out<<"\n  States:\n";
+        for (int i = 0; i < graph->num_states; i++)
+        {
+            int state = graph->state_order[i];
+            out<<"    V["<<graph->state_name[state]<<"] = "<<V[state]<<"\n";
+        }
+        out<<"\n  Transitions:\n";
+        for (int i = 0; i < graph->num_transitions; i++)
+        {
+            int trans = graph->transition_order[i];
+            int from = graph->edge_from[trans];
+            out<<"     Q["<<graph->state_name[from]<<" -> "<<graph->state_name[graph->edges[trans].to]<<"] = "<<Q[trans]<<": ";
+            if (graph->type[from] == DETERMINISTIC)
+            {
+                out<<"         ("<<graph->action_name[graph->edges[trans].Action()]<<")               policy = "<<policy[trans];
+            }
+            out<<"\n";
+        }
+        out<<"\n";
+    }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "sweep.h"
+#include "model-file.h"
+
+// sweep < task.txt -- or sweep task.txt, which goes through the compiled model cache
+int main(int argc, char **argv)
+{
+    // -------------------------------------------
+    //                Read Experiment
+    // -------------------------------------------
+
+    ExperimentalModel *model = new ExperimentalModel();
+
+    TaskError error;
+    bool ok = argc > 1 ? LoadModelCached(model, argv[1], error) : ReadTaskStream(model, cin, error);
+    if (!ok)
+    {
+        cerr<<error.ToString()<<"\n";
+        return 1;
+    }
+
+    // -------------------------------------------
+    //                Simulate Experiment
+    // -------------------------------------------
+
+    SweepGrid grid;
+    grid.learners.clear();
+    grid.learners.push_back(LEARNER_ACTOR_CRITIC);
+    grid.learners.push_back(LEARNER_SARSA);
+    grid.learners.push_back(LEARNER_Q_LEARNING);
+    grid.methods.clear();
+    grid.methods.push_back(SOFTMAX);
+    grid.methods.push_back(PROBABILITY_MATCHING);
+    grid.methods.push_back(EPS_GREEDY);
+    grid.seeds.clear();
+    for (int seed = 0; seed < 4; seed++)
+    {
+        grid.seeds.push_back(seed);
+    }
+    grid.trials = 300000;
+
+    vector<RLConfig> configs = grid.Expand();
+    SweepResults results;
+    Sweep sweep(model);
+    sweep.Run(configs, results);
+
+    // -------------------------------------------
+    //                Print Results
+    // -------------------------------------------
+
+    for (int i = 0; i < results.results.size(); i++)
+    {
+        cout<<"\n%% ====== run "<<i<<": "<<results.results[i].config.ToString()<<" ======\n";
+        if (results.results[i].converged_at != -1)
+        {
+            cout<<"%% converged after "<<results.results[i].converged_at<<" trials\n";
+        }
+        cout<<results.results[i].precision;
+        cout<<"figure;\n";
+        cout<<results.results[i].figures;
+    }
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "rl-config.h"
+#include "morris.h"
+#include "measurement.h"
+#include "thread-pool.h"
+
+// grid of configurations -- Expand() returns the cartesian product of all the lists
+struct SweepGrid
+{
+    vector<LearnerType> learners;
+    vector<ActionSelectionMethod> methods;
+    vector<DAInterpretation> interpretations;
+    vector<double> etas;
+    vector<double> alphas;
+    vector<double> gammas;
+    vector<double> betas;
+    vector<double> min_Rs;
+    vector<double> noises;
+    vector<double> epss;
+    vector<uint64_t> seeds;
+    int trials;
+    bool compress_chains;
+    bool mean_field;
+    bool exact_statistics;
+    Convergence convergence;
+    vector<pair<string, double> > measure;
+    int measure_max_trials;
+
+    // every list starts out with the single default value of RLConfig
+    SweepGrid()
+    {
+        RLConfig config;
+        learners.push_back(config.learner);
+        methods.push_back(config.method);
+        interpretations.push_back(config.interpretation);
+        etas.push_back(config.eta);
+        alphas.push_back(config.alpha);
+        gammas.push_back(config.gamma);
+        betas.push_back(config.beta);
+        min_Rs.push_back(config.min_R);
+        noises.push_back(config.noise);
+        epss.push_back(config.eps);
+        seeds.push_back(config.seed);
+        trials = config.trials;
+        compress_chains = config.compress_chains;
+        mean_field = config.mean_field;
+        exact_statistics = config.exact_statistics;
+        convergence = config.convergence;
+        measure = config.measure;
+        measure_max_trials = config.measure_max_trials;
+    }
+
+    vector<RLConfig> Expand() const
+    {
+        vector<RLConfig> configs;
+        RLConfig config;
+        config.trials = trials;
+        config.compress_chains = compress_chains;
+        config.mean_field = mean_field;
+        config.exact_statistics = exact_statistics;
+        config.convergence = convergence;
+        config.measure = measure;
+        config.measure_max_trials = measure_max_trials;
+        for (int a = 0; a < learners.size(); a++)
+        for (int b = 0; b < methods.size(); b++)
+        for (int k = 0; k < interpretations.size(); k++)
+        for (int c = 0; c < etas.size(); c++)
+        for (int d = 0; d < alphas.size(); d++)
+        for (int e = 0; e < gammas.size(); e++)
+        for (int f = 0; f < betas.size(); f++)
+        for (int g = 0; g < min_Rs.size(); g++)
+        for (int h = 0; h < noises.size(); h++)
+        for (int i = 0; i < epss.size(); i++)
+        for (int j = 0; j < seeds.size(); j++)
+        {
+            config.learner = learners[a];
+            config.method = methods[b];
+            config.interpretation = interpretations[k];
+            config.eta = etas[c];
+            config.alpha = alphas[d];
+            config.gamma = gammas[e];
+            config.beta = betas[f];
+            config.min_R = min_Rs[g];
+            config.noise = noises[h];
+            config.eps = epss[i];
+            config.seed = seeds[j];
+            configs.push_back(config);
+        }
+        return configs;
+    }
+};
+
+
+struct SweepResult
+{
+    RLConfig config;
+    RLMethod *learner; // final tables; owned by the SweepResults
+    int trials_run;    // config.trials (fewer if the run converged early), plus the measurement phase
+    int converged_at;  // trial the tables converged at, or -1
+    string precision;  // what the measurement phase got to (Measurement::Print), if there was one
+    string figures;    // the Morris figures for this run; measured ones plot the means of the measurement phase
+};
+
+
+class SweepResults
+{
+private:
+    SweepResults(const SweepResults&);
+    SweepResults& operator=(const SweepResults&);
+
+public:
+    vector<SweepResult> results; // in the order of the configs
+
+    SweepResults() { }
+
+    ~SweepResults()
+    {
+        for (int i = 0; i < results.size(); i++)
+        {
+            delete results[i].learner;
+        }
+    }
+};
+
+
+// runs many configurations on one shared, read-only model
+class Sweep
+{
+private:
+    ExperimentalModel *model;
+    int num_workers;
+    double bias; // dopamine/PE base line for the figures
+
+public:
+    Sweep(ExperimentalModel *experiment_model, int workers = WorkStealingPool::DefaultWorkers(), double dopamine_bias = 75) :
+        model(experiment_model),
+        num_workers(workers),
+        bias(dopamine_bias)
+    { }
+
+    void Run(const vector<RLConfig> &configs, SweepResults &out)
+    {
+        out.results.resize(configs.size());
+        // the compressed graphs are shared by all the workers, so they are built up front
+        // (and the measurements are checked before anything runs)
+        for (int i = 0; i < configs.size(); i++)
+        {
+            if (configs[i].compress_chains && model->CompressChains(configs[i].gamma) == NULL)
+            {
+                cerr<<"Cannot compress the chains of the model (a chain loops back on itself). Aborting the sweep.\n";
+                out.results.clear();
+                return;
+            }
+            if (!configs[i].measure.empty() && configs[i].mean_field)
+            {
+                cerr<<"Cannot measure a mean-field run (it samples no statistics). Aborting the sweep.\n";
+                out.results.clear();
+                return;
+            }
+            if (!configs[i].measure.empty() && configs[i].exact_statistics)
+            {
+                cerr<<"Cannot measure a run with exact statistics (its figures are the expectations already). Aborting the sweep.\n";
+                out.results.clear();
+                return;
+            }
+            for (int j = 0; j < configs[i].measure.size(); j++)
+            {
+                if (!Measurement::Known(configs[i].measure[j].first))
+                {
+                    cerr<<"Cannot measure figure '"<<configs[i].measure[j].first<<"'. Aborting the sweep.\n";
+                    out.results.clear();
+                    return;
+                }
+                for (int k = 0; k < j; k++)
+                {
+                    if (configs[i].measure[k].first == configs[i].measure[j].first)
+                    {
+                        cerr<<"Figure '"<<configs[i].measure[j].first<<"' is to be measured twice. Aborting the sweep.\n";
+                        out.results.clear();
+                        return;
+                    }
+                }
+            }
+        }
+        WorkStealingPool pool(num_workers);
+        pool.Run(configs.size(), [&](int i) {
+            SweepResult &result = out.results[i];
+            result.config = configs[i];
+            result.learner = CreateRLMethod(model, configs[i]);
+            RunOptions options;
+            options.convergence = configs[i].convergence;
+            result.trials_run = result.learner->RunTrials(configs[i].trials, options);
+            result.converged_at = result.learner->ConvergedAt();
+            if (configs[i].exact_statistics)
+            {
+                result.learner->ExpectStatistics(result.trials_run);
+            }
+            ostringstream figures;
+            Morris morris(result.learner, bias, figures);
+            // a measured figure plots the means of the measurement phase, not its last look
+            if (!configs[i].measure.empty())
+            {
+                Measurement measurement(result.learner, bias);
+                for (int j = 0; j < configs[i].measure.size(); j++)
+                {
+                    measurement.Require(configs[i].measure[j].first, configs[i].measure[j].second);
+                }
+                result.trials_run += measurement.Run(configs[i].measure_max_trials);
+                measurement.PlotMeasured(morris);
+                ostringstream precision;
+                measurement.Print(precision);
+                result.precision = precision.str();
+            }
+            morris.AllFigures();
+            result.figures = figures.str();
+        });
+    }
+};
+
+#endif
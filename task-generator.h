@@ -0,0 +1,364 @@
+#ifndef TASK_GENERATOR_H
+#define TASK_GENERATOR_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+
+#include "model.h"
+
+using namespace std;
+
+// which side the two options of a decision trial go on
+enum Placement
+{
+    PLACE_BOTH_SIDES, // every ordered pair -- K^2 decision states, each option on either side
+    PLACE_HIGH_LEFT,  // every unordered pair, the better option on the left -- K(K+1)/2 states
+    PLACE_HIGH_RIGHT  // every unordered pair, the better option on the right
+};
+
+
+// a Morris-style task: reference trials show one of K cues at one of fan_out positions and pay
+// off only for the button at that position, decision trials show two cues and pay off for either
+//
+// the default is morris-trial-delayed-reward-new.txt, state for state and edge for edge
+struct MorrisDesign
+{
+    vector<double> levels; // reward probabilities of the reference cues, in percent; distinct to 6 digits
+    Placement placement;
+    int delay;      // wait states between a chosen reward state and its lottery
+    int fan_out;    // buttons per cue state; a decision trial puts its pair on the first two
+    double reference_fraction; // of trials, split evenly over the reference cue states
+    double juice;   // reward of a won lottery
+
+    MorrisDesign() :
+        placement(PLACE_BOTH_SIDES),
+        delay(0),
+        fan_out(2),
+        reference_fraction(0.9),
+        juice(100)
+    {
+        levels.push_back(25);
+        levels.push_back(50);
+        levels.push_back(75);
+        levels.push_back(100);
+    }
+
+    // K levels evenly spaced up to 100% (100/K, 200/K, ..., 100)
+    static MorrisDesign Uniform(int K)
+    {
+        MorrisDesign design;
+        design.levels.clear();
+        for (int i = 1; i <= K; i++)
+        {
+            design.levels.push_back(100.0 * i / K);
+        }
+        return design;
+    }
+
+    long long NumDecisionStates() const
+    {
+        long long K = levels.size();
+        return placement == PLACE_BOTH_SIDES ? K * K : K * (K + 1) / 2;
+    }
+
+    long long NumStates() const
+    {
+        long long K = levels.size();
+        return 2 + K * fan_out + NumDecisionStates() + K * (delay + 2) + 3;
+    }
+
+    long long NumTransitions() const
+    {
+        long long K = levels.size();
+        return 1 + K * fan_out * (fan_out + 1) + NumDecisionStates() * (fan_out + 1) + K * (delay + 3) + 2;
+    }
+
+    // level i as it appears in names -- 6 significant digits, so 100/3 is "33.3333"
+    string LevelName(int i) const
+    {
+        ostringstream ss;
+        ss<<levels[i];
+        return ss.str();
+    }
+
+    // what is wrong with the design, or "" if nothing is
+    string Check() const
+    {
+        if (levels.empty())
+        {
+            return "no reward levels";
+        }
+        for (int i = 0; i < levels.size(); i++)
+        {
+            if (!(levels[i] >= 0 && levels[i] <= 100))
+            {
+                return "reward level " + NumberToString(levels[i]) + " is not a percentage";
+            }
+        }
+        vector<string> names;
+        for (int i = 0; i < levels.size(); i++)
+        {
+            names.push_back(LevelName(i));
+        }
+        sort(names.begin(), names.end());
+        for (int i = 1; i < names.size(); i++)
+        {
+            if (names[i] == names[i - 1])
+            {
+                return "two reward levels are both named " + names[i];
+            }
+        }
+        if (fan_out < 2)
+        {
+            return "a fan-out below 2 leaves no room for a decision";
+        }
+        if (delay < 0)
+        {
+            return "negative delay";
+        }
+        if (!(reference_fraction >= 0 && reference_fraction <= 1))
+        {
+            return "the reference fraction is not a probability";
+        }
+        if (NumStates() > 1000000000 || NumTransitions() > 1000000000)
+        {
+            return "too large for int ids";
+        }
+        return "";
+    }
+};
+
+
+// appends cues, states and transitions to a model the way TaskParser does, minus the name checks
+// (names are indexed by Finish, once they are all in)
+class TaskBuilder
+{
+private:
+    ExperimentalModel *model;
+
+public:
+    TaskBuilder(ExperimentalModel *target) :
+        model(target)
+    { }
+
+    Cue* AddCue(const string &name, double value)
+    {
+        Cue *cue = model->AddCue(name);
+        cue->value = value;
+        return cue;
+    }
+
+    State* AddState(const string &name, double reward, StateType type, Cue *cue = NULL, const string &extra = "no-extra")
+    {
+        State *state = model->AddState(name);
+        state->reward = reward;
+        state->type = type;
+        state->extra = model->arena.Copy(extra);
+        if (cue != NULL)
+        {
+            state->cue = cue;
+            cue->states.push_back(state);
+        }
+        return state;
+    }
+
+    Transition* AddChance(State *from, State *to, double probability)
+    {
+        assert(from->type == PROBABILISTIC);
+        Transition *trans = model->arena.New<Transition>(from, to, CHANCE);
+        trans->probability = probability;
+        Link(trans);
+        return trans;
+    }
+
+    Transition* AddChoice(State *from, State *to, int action)
+    {
+        assert(from->type == DETERMINISTIC);
+        Transition *trans = model->arena.New<Transition>(from, to, CHOICE);
+        trans->action = action;
+        Link(trans);
+        return trans;
+    }
+
+    // index the names, now that they are all in
+    void Finish()
+    {
+        int duplicate = model->cue_names.Build();
+        assert(duplicate == -1);
+        duplicate = model->state_names.Build();
+        assert(duplicate == -1);
+        (void)duplicate;
+    }
+
+    void Link(Transition *trans)
+    {
+        model->transitions.push_back(trans);
+        trans->from->out.push_back(trans);
+        trans->to->in.push_back(trans);
+    }
+};
+
+
+// build the task of design into an empty model and compile it
+// names follow the hand-written files: cue "X" and states cue-X-L / cue-X-R for the reference cue
+// of X%, cue "Y-X" (Y >= X) for a pair, cue-A-B for the pair with A on the left, reward-X (extra X,
+// the name of the reference cue Morris looks for), wait-X-1 ... wait-X-d, reward-X-real, and
+// get-juice / get-no-juice; with more than two buttons the positions are P0, P1, ... and the
+// actions press-0, press-1, ... instead of L, R and left, right
+inline void GenerateMorrisTask(const MorrisDesign &design, ExperimentalModel *model)
+{
+    assert(design.Check().empty());
+    assert(model->states.empty());
+    int K = design.levels.size();
+    int n = design.fan_out;
+    TaskBuilder builder(model);
+
+    vector<string> level_name(K);
+    for (int i = 0; i < K; i++)
+    {
+        level_name[i] = design.LevelName(i);
+    }
+    vector<string> position(n);
+    vector<int> action(n);
+    for (int p = 0; p < n; p++)
+    {
+        position[p] = n == 2 ? (p == 0 ? "L" : "R") : "P" + to_string(p);
+        action[p] = model->ActionId(n == 2 ? (p == 0 ? "left" : "right") : "press-" + to_string(p));
+    }
+
+    // cues -- the references in level order, then the pairs by value (and by better option on ties)
+    vector<Cue*> reference_cue(K);
+    for (int i = 0; i < K; i++)
+    {
+        reference_cue[i] = builder.AddCue(level_name[i], design.levels[i]);
+    }
+    vector<pair<int, int> > pairs; // (better, worse) level
+    for (int i = 0; i < K; i++)
+    {
+        for (int j = 0; j < K; j++)
+        {
+            if (design.levels[i] >= design.levels[j])
+            {
+                pairs.push_back(make_pair(i, j));
+            }
+        }
+    }
+    const vector<double> &levels = design.levels;
+    stable_sort(pairs.begin(), pairs.end(), [&levels](const pair<int, int> &a, const pair<int, int> &b)
+    {
+        double value_a = levels[a.first] + levels[a.second];
+        double value_b = levels[b.first] + levels[b.second];
+        if (value_a != value_b)
+        {
+            return value_a < value_b;
+        }
+        return levels[a.first] < levels[b.first];
+    });
+    vector<Cue*> pair_cue(K * K, NULL); // by better * K + worse
+    for (int i = 0; i < pairs.size(); i++)
+    {
+        int high = pairs[i].first, low = pairs[i].second;
+        pair_cue[high * K + low] = builder.AddCue(level_name[high] + "-" + level_name[low], (design.levels[high] + design.levels[low]) / 2);
+    }
+
+    // states
+    State *pre_start = builder.AddState("pre-start", 0, PROBABILISTIC);
+    State *start = builder.AddState("start", 0, PROBABILISTIC);
+    vector<State*> reference_state(K * n); // by position * K + level
+    for (int p = 0; p < n; p++)
+    {
+        for (int i = 0; i < K; i++)
+        {
+            reference_state[p * K + i] = builder.AddState("cue-" + level_name[i] + "-" + position[p], 0, DETERMINISTIC, reference_cue[i]);
+        }
+    }
+    vector<pair<int, int> > shown; // (left, right) level of every decision state
+    vector<State*> decision_state;
+    for (int a = 0; a < K; a++)
+    {
+        for (int b = 0; b < K; b++)
+        {
+            bool a_better = design.levels[a] >= design.levels[b];
+            if ((design.placement == PLACE_HIGH_LEFT && !a_better) || (design.placement == PLACE_HIGH_RIGHT && a_better && a != b))
+            {
+                continue;
+            }
+            Cue *cue = a_better ? pair_cue[a * K + b] : pair_cue[b * K + a];
+            shown.push_back(make_pair(a, b));
+            decision_state.push_back(builder.AddState("cue-" + level_name[a] + "-" + level_name[b], 0, DETERMINISTIC, cue));
+        }
+    }
+    vector<State*> reward(K), real(K);
+    vector<vector<State*> > wait(K);
+    for (int i = 0; i < K; i++)
+    {
+        reward[i] = builder.AddState("reward-" + level_name[i], 0, PROBABILISTIC, NULL, level_name[i]);
+    }
+    for (int d = 1; d <= design.delay; d++)
+    {
+        for (int i = 0; i < K; i++)
+        {
+            wait[i].push_back(builder.AddState("wait-" + level_name[i] + "-" + to_string(d), 0, PROBABILISTIC));
+        }
+    }
+    for (int i = 0; i < K; i++)
+    {
+        real[i] = builder.AddState("reward-" + level_name[i] + "-real", 0, PROBABILISTIC);
+    }
+    State *juice = builder.AddState("get-juice", design.juice, PROBABILISTIC);
+    State *no_juice = builder.AddState("get-no-juice", 0, PROBABILISTIC);
+    State *end = builder.AddState("end", 0, PROBABILISTIC);
+
+    // transitions
+    builder.AddChance(pre_start, start, 1);
+    for (int s = 0; s < reference_state.size(); s++)
+    {
+        builder.AddChance(start, reference_state[s], design.reference_fraction / reference_state.size());
+    }
+    for (int s = 0; s < reference_state.size(); s++)
+    {
+        int p = s / K, i = s % K;
+        for (int q = 0; q < n; q++)
+        {
+            builder.AddChoice(reference_state[s], q == p ? reward[i] : end, action[q]);
+        }
+    }
+    for (int s = 0; s < decision_state.size(); s++)
+    {
+        builder.AddChance(start, decision_state[s], (1 - design.reference_fraction) / decision_state.size());
+    }
+    for (int s = 0; s < decision_state.size(); s++)
+    {
+        builder.AddChoice(decision_state[s], reward[shown[s].first], action[0]);
+        builder.AddChoice(decision_state[s], reward[shown[s].second], action[1]);
+        for (int q = 2; q < n; q++)
+        {
+            builder.AddChoice(decision_state[s], end, action[q]);
+        }
+    }
+    for (int i = 0; i < K; i++)
+    {
+        State *last = reward[i];
+        for (int d = 0; d < design.delay; d++)
+        {
+            builder.AddChance(last, wait[i][d], 1);
+            last = wait[i][d];
+        }
+        builder.AddChance(last, real[i], 1);
+    }
+    for (int i = 0; i < K; i++)
+    {
+        builder.AddChance(real[i], juice, design.levels[i] / 100);
+        builder.AddChance(real[i], no_juice, 1 - design.levels[i] / 100);
+    }
+    builder.AddChance(juice, end, 1);
+    builder.AddChance(no_juice, end, 1);
+
+    builder.Finish();
+    model->FindStartAndEnd();
+    model->Compile();
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef TASK_PARSER_H
+#define TASK_PARSER_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <charconv>
+
+#include "model.h"
+#include "mapped-file.h"
+
+using namespace std;
+
+// where and why a task file was rejected
+struct TaskError
+{
+    string file;
+    int line;   // 1-based
+    int column; // 1-based
+    string message;
+
+    TaskError() :
+        line(0),
+        column(0)
+    { }
+
+    bool Failed() const
+    {
+        return !message.empty();
+    }
+
+    // file:line:column: message
+    string ToString() const
+    {
+        ostringstream ss;
+        ss<<file<<":"<<line<<":"<<column<<": "<<message;
+        return ss.str();
+    }
+};
+
+
+// whitespace-separated tokens of a task file in a buffer, with the line and column of each
+// for the readers below; on a bad token, Fail fills in the TaskError and returns false
+class TaskScanner
+{
+protected:
+    const char *pos;
+    const char *end;
+    const char *line_start;
+    int line;
+    string file_name;
+    TaskError *error;
+
+    string_view token; // the last token read
+    const char *token_line_start;
+    int token_line;
+
+    static bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    // advance to the next token; false at the end of the buffer
+    bool Next()
+    {
+        while (pos < end && IsSpace(*pos))
+        {
+            if (*pos == '\n')
+            {
+                line++;
+                line_start = pos + 1;
+            }
+            pos++;
+        }
+        token_line = line;
+        token_line_start = line_start;
+        if (pos == end)
+        {
+            token = string_view(pos, 0);
+            return false;
+        }
+        const char *begin = pos;
+        while (pos < end && !IsSpace(*pos))
+        {
+            pos++;
+        }
+        token = string_view(begin, pos - begin);
+        return true;
+    }
+
+    bool Fail(const string &message)
+    {
+        error->file = file_name;
+        error->line = token_line;
+        error->column = token.data() - token_line_start + 1;
+        error->message = message;
+        return false;
+    }
+
+    bool Expect(const char *what)
+    {
+        if (!Next())
+        {
+            return Fail(string("unexpected end of file, expected ") + what);
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool Number(T &value, const char *what)
+    {
+        if (!Expect(what))
+        {
+            return false;
+        }
+        const char *begin = token.data();
+        const char *stop = begin + token.size();
+        if (begin < stop && *begin == '+')
+        {
+            begin++; // istream takes a leading +, from_chars does not
+        }
+        from_chars_result result = from_chars(begin, stop, value);
+        if (result.ec != errc() || result.ptr != stop)
+        {
+            return Fail(string("expected ") + what + ", got '" + string(token) + "'");
+        }
+        return true;
+    }
+
+    // where the scan is -- Rewind goes back to it, for readers that take more than one pass
+    struct Mark
+    {
+        const char *pos;
+        const char *line_start;
+        int line;
+    };
+
+    Mark Here() const
+    {
+        Mark mark;
+        mark.pos = pos;
+        mark.line_start = line_start;
+        mark.line = line;
+        return mark;
+    }
+
+    void Rewind(const Mark &mark)
+    {
+        pos = mark.pos;
+        line_start = mark.line_start;
+        line = mark.line;
+    }
+
+    // fail at the first token of item item of a section of items of tokens_per_item tokens
+    // starting at section -- for errors only found once the whole section is in, like duplicates
+    bool FailAt(const Mark &section, int tokens_per_item, int item, const string &message)
+    {
+        Rewind(section);
+        for (long long i = 0; i <= (long long)tokens_per_item * item; i++)
+        {
+            Next();
+        }
+        return Fail(message);
+    }
+
+public:
+    TaskScanner(const char *data, size_t size, const string &name) :
+        pos(data),
+        end(data + size),
+        line_start(data),
+        line(1),
+        file_name(name),
+        error(NULL),
+        token(data, 0),
+        token_line_start(data),
+        token_line(1)
+    { }
+};
+
+
+// reads the task format of format.txt out of a buffer in one pass
+//
+// it accepts exactly what ExperimentalModel::Read accepts -- whitespace-separated tokens,
+// line breaks anywhere -- but numbers go through from_chars, names are interned into the
+// model's name pools and looked up through their perfect hashes, nothing is echoed unless asked for,
+// and a bad file is reported through a TaskError rather than by exiting.
+// The model is built the same way Read builds it, so it compiles to the same graph.
+class TaskParser : public TaskScanner
+{
+public:
+    TaskParser(const char *data, size_t size, const string &name = "<task>") :
+        TaskScanner(data, size, name)
+    { }
+
+    // build model from the buffer, echoing every state to echo unless it is NULL (as Read does)
+    // on failure, err says where; model is then partially filled and should be thrown away
+    bool Parse(ExperimentalModel *model, TaskError &err, ostream *echo = NULL)
+    {
+        error = &err;
+        err = TaskError();
+
+        int C;
+        if (!Number(C, "the number of cues"))
+        {
+            return false;
+        }
+        if (C < 0)
+        {
+            return Fail("negative number of cues");
+        }
+        // names are only looked up once their section is complete, so duplicates are found then
+        Mark cues_start = Here();
+        model->cues.reserve(model->cues.size() + C);
+        for (int i = 0; i < C; i++)
+        {
+            if (!Expect("a cue name"))
+            {
+                return false;
+            }
+            Cue *cue = model->AddCue(token);
+            if (!Number(cue->value, "a cue value"))
+            {
+                return false;
+            }
+        }
+        int duplicate = model->cue_names.Build();
+        if (duplicate != -1)
+        {
+            return FailAt(cues_start, 2, duplicate, "duplicate cue name '" + string(model->cue_names.Name(duplicate)) + "'");
+        }
+
+        int N;
+        if (!Number(N, "the number of states"))
+        {
+            return false;
+        }
+        if (N < 0)
+        {
+            return Fail("negative number of states");
+        }
+        Mark states_start = Here();
+        model->states.reserve(model->states.size() + N);
+        model->state_names.Reserve(model->state_names.Size() + N);
+        for (int i = 0; i < N; i++)
+        {
+            if (!Expect("a state name"))
+            {
+                return false;
+            }
+            State *state = model->AddState(token);
+            if (!Number(state->reward, "a state reward") || !Expect("a state type"))
+            {
+                return false;
+            }
+            state->type = token[0] == 'D' || token[0] == 'd' ? DETERMINISTIC : PROBABILISTIC;
+            if (!Expect("a cue name"))
+            {
+                return false;
+            }
+            string_view cue_name = token;
+            int cue = model->cue_names.Find(cue_name);
+            if (cue != -1)
+            {
+                state->cue = model->cues[cue];
+                model->cues[cue]->states.push_back(state);
+            }
+            if (!Expect("the extra of a state"))
+            {
+                return false;
+            }
+            state->extra = model->arena.Copy(token);
+            if (echo != NULL)
+            {
+                *echo<<state->name<<" "<<state->reward<<" "<<state->type<<" "<<cue_name<<"\n";
+            }
+        }
+        duplicate = model->state_names.Build();
+        if (duplicate != -1)
+        {
+            return FailAt(states_start, 5, duplicate, "duplicate state name '" + string(model->state_names.Name(duplicate)) + "'");
+        }
+
+        while (Next())
+        {
+            int from = model->state_names.Find(token);
+            if (from == -1)
+            {
+                return Fail("no state with name '" + string(token) + "' exists");
+            }
+            if (!Expect("the target state of a transition"))
+            {
+                return false;
+            }
+            int to = model->state_names.Find(token);
+            if (to == -1)
+            {
+                return Fail("no state with name '" + string(token) + "' exists");
+            }
+            Transition *trans;
+            if (model->states[from]->type == PROBABILISTIC)
+            {
+                trans = model->arena.New<Transition>(model->states[from], model->states[to], CHANCE);
+                model->transitions.push_back(trans);
+                if (!Number(trans->probability, "a transition probability"))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                trans = model->arena.New<Transition>(model->states[from], model->states[to], CHOICE);
+                model->transitions.push_back(trans);
+                if (!Expect("an action name"))
+                {
+                    return false;
+                }
+                trans->action = model->ActionId(token);
+            }
+            trans->from->out.push_back(trans);
+            trans->to->in.push_back(trans);
+        }
+
+        model->FindStartAndEnd();
+        model->Compile();
+        return true;
+    }
+};
+
+
+// read the task file at path straight out of a read-only mapping of it
+inline bool ReadTaskFile(ExperimentalModel *model, const string &path, TaskError &error, ostream *echo = NULL)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = TaskError();
+        error.file = path;
+        error.message = "cannot read the task file";
+        return false;
+    }
+    TaskParser parser(file.data, file.size, path);
+    return parser.Parse(model, error, echo);
+}
+
+// read a whole task from in (e.g. cin) and parse it
+inline bool ReadTaskStream(ExperimentalModel *model, istream &in, TaskError &error, ostream *echo = NULL, const string &name = "<stdin>")
+{
+    ostringstream ss;
+    ss<<in.rdbuf();
+    string text = ss.str();
+    TaskParser parser(text.data(), text.size(), name);
+    return parser.Parse(model, error, echo);
+}
+
+#endif
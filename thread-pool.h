@@ -0,0 +1,112 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+
+using namespace std;
+
+// runs a fixed batch of tasks on a set of workers
+// each worker owns a deque of task indices: it pops its own tasks from the back
+// and, once it runs dry, steals from the front of the others', so long runs
+// do not leave the rest of the cores idle
+class WorkStealingPool
+{
+private:
+    struct Queue
+    {
+        mutex lock;
+        deque<int> tasks;
+    };
+
+    int num_workers;
+    vector<Queue*> queues;
+
+    bool PopOwn(int worker, int &task)
+    {
+        Queue *queue = queues[worker];
+        lock_guard<mutex> guard(queue->lock);
+        if (queue->tasks.empty())
+        {
+            return false;
+        }
+        task = queue->tasks.back();
+        queue->tasks.pop_back();
+        return true;
+    }
+
+    bool Steal(int worker, int &task)
+    {
+        for (int i = 1; i < num_workers; i++)
+        {
+            Queue *victim = queues[(worker + i) % num_workers];
+            lock_guard<mutex> guard(victim->lock);
+            if (!victim->tasks.empty())
+            {
+                task = victim->tasks.front();
+                victim->tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Work(int worker, const function<void(int)> &run)
+    {
+        int task;
+        // no new tasks appear once Run() started, so one empty sweep over all queues means we are done
+        while (PopOwn(worker, task) || Steal(worker, task))
+        {
+            run(task);
+        }
+    }
+
+public:
+    WorkStealingPool(int workers) :
+        num_workers(workers > 0 ? workers : 1)
+    {
+        for (int i = 0; i < num_workers; i++)
+        {
+            queues.push_back(new Queue());
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        for (int i = 0; i < queues.size(); i++)
+        {
+            delete queues[i];
+        }
+    }
+
+    // calls run(0) .. run(num_tasks - 1) and returns once all of them finished
+    void Run(int num_tasks, const function<void(int)> &run)
+    {
+        // deal the tasks out round-robin; stealing evens out the rest
+        for (int task = num_tasks - 1; task >= 0; task--)
+        {
+            queues[task % num_workers]->tasks.push_back(task);
+        }
+        vector<thread> threads;
+        for (int worker = 1; worker < num_workers; worker++)
+        {
+            threads.push_back(thread(&WorkStealingPool::Work, this, worker, cref(run)));
+        }
+        Work(0, run);
+        for (int i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+        }
+    }
+
+    static int DefaultWorkers()
+    {
+        int n = thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+};
+
+#endif